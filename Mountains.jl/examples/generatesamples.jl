@@ -69,4 +69,34 @@ for (msize, r, h) in (("tiny",  chirp(0, 15, 1, 100), range(-0.1, 0.1, length=10
                  plot!(DSN[begin:i], color=:magenta, label="derivative")
              end, layout=(2, 1))
     end every Int(round(length(HN)/50))
-end
\ No newline at end of file
+end
+
+
+
+# Multi-dimensional samples, with the height starting as a small fraction of the uplift rate
+for (name, r) in (("2d-tiny", [((3i+j)%8)/3.5-1 for i in 1:24, j in 1:32]),
+                  ("3d-tiny", [((i+2j+3k)%7)/3-1 for i in 1:8, j in 1:10, k in 1:12]))
+    m = MountainRange(r, r./100)
+    write("$name-in.mr", m)
+    solve!(m)
+    write("$name-out.mr", m)
+end
+
+
+
+# References for mountainsolve's adaptive integrator (SOLVER_INTEGRATOR=adaptive): the same ranges solved as an ODE to a
+# far tighter tolerance than the integrator's default, stopping where the steepness derivative reaches eps as
+# solve_diffeq.jl does. The committed references come from samples/generate-ode-references.py, which does the same
+# with SciPy; the two agree to about 1e-9.
+using DifferentialEquations
+for name in ("1d-tiny", "2d-tiny")
+    m = MountainRange("$name-in.mr")
+    stoppingcondition(h, args...) = dsteepness(h, Mountains.growthrate(h, m.r))-eps(Float64)
+    callback = ContinuousCallback(stoppingcondition, terminate!, interp_points=0)
+    prob = ODEProblem{true}((g, h, r, t)->Mountains.growthrate!(g, h, r), m.h, (m.t[], 10000), m.r,
+                            callback=callback, save_on=false, save_start=false)
+    sol = solve(prob, DP5(), abstol=1e-12, reltol=1e-12)
+    m.t[] = last(sol.t)
+    m.h .= last(sol.u)
+    write("$name-ode-out.mr", m)
+end
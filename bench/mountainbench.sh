@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+
+# Runs every mountainbench binary in the supplied build directory, sweeping MPI process counts for mountainbench_mpi,
+# and writes their results as CSV with a parallel efficiency column added. If a baseline from an earlier run is
+# supplied, every measurement more than MOUNTAINBENCH_TOLERANCE (default 0.1, i.e. 10%) slower than its baseline
+# counterpart is flagged as a regression, and the script fails if there are any.
+
+# Parallel efficiency is the speedup over the same backend with 1 process and 1 thread divided by the number of
+# processes times threads; it's left empty if there's no 1-worker measurement to compare to.
+
+# Environment variables:
+#   MOUNTAINBENCH_MAX_CELLS  size of the largest range benchmarked (default 16777216)
+#   MOUNTAINBENCH_MAX_RANKS  largest MPI process count (default the number of cores)
+#   MOUNTAINBENCH_TOLERANCE  fraction by which a measurement may be slower than the baseline (default 0.1)
+#   MPIRUN                   command to launch MPI programs (default mpirun)
+
+# Arguments: build directory, results file, and optionally a baseline results file
+
+# Example:
+# bench/mountainbench.sh bld bld/mountainbench.csv baseline.csv
+
+set -e
+
+# Parse
+bindir="$1"
+results="$2"
+baseline="$3"
+max_cells="${MOUNTAINBENCH_MAX_CELLS:-16777216}"
+max_ranks="${MOUNTAINBENCH_MAX_RANKS:-$(nproc)}"
+tolerance="${MOUNTAINBENCH_TOLERANCE:-0.1}"
+read -r -a mpirun <<< "${MPIRUN:-mpirun}"
+
+# Run from a scratch directory, where the benchmarks write their input files
+workdir="$(mktemp -d)"
+trap 'rm -r "$workdir"' EXIT
+raw="$workdir/raw.csv"
+bench() {
+    echo "Running $*" >&2
+    (cd "$workdir" && "$@" "$max_cells") > "$workdir/out.csv"
+    if [[ ! -s "$raw" ]]; then cat "$workdir/out.csv"; else tail -n +2 "$workdir/out.csv"; fi >> "$raw"
+}
+
+# Benchmark each backend that was built, with MPI on 1, 2, 4, ... processes up to max_ranks
+for backend in serial openmp float thread stdpar; do
+    [[ -x "$bindir/mountainbench_$backend" ]] && bench "$(realpath "$bindir/mountainbench_$backend")"
+done
+if [[ -x "$bindir/mountainbench_mpi" ]]; then
+    for ((n=1; n<max_ranks; n*=2)); do
+        bench "${mpirun[@]}" -n "$n" "$(realpath "$bindir/mountainbench_mpi")"
+    done
+    bench "${mpirun[@]}" -n "$max_ranks" "$(realpath "$bindir/mountainbench_mpi")"
+fi
+
+# Add parallel efficiency; columns are backend,ranks,threads,operation,cells,seconds,cells_per_second,gb_per_second
+awk -F, -v OFS=, '
+    NR == FNR { if ($2 * $3 == 1) serial[$1 FS $4 FS $5] = $7; next }
+    FNR == 1  { print $0, "efficiency"; next }
+    !seen[$1 FS $2 FS $3 FS $4 FS $5]++ {
+        key = $1 FS $4 FS $5
+        print $0, (key in serial) ? sprintf("%.3f", $7 / serial[key] / ($2 * $3)) : ""
+    }' "$raw" "$raw" > "$results"
+echo "Wrote $results" >&2
+
+# Compare to the baseline
+if [[ -n "$baseline" ]]; then
+    awk -F, -v tolerance="$tolerance" '
+        NR == FNR { if (FNR > 1) base[$1 FS $2 FS $3 FS $4 FS $5] = $7; next }
+        FNR == 1  { next }
+        ($1 FS $2 FS $3 FS $4 FS $5) in base {
+            compared++
+            ratio = $7 / base[$1 FS $2 FS $3 FS $4 FS $5]
+            if (ratio < 1 - tolerance) {
+                regressed++
+                printf "REGRESSION: %s %s, %d processes of %d threads, %d cells: %.4g cells/s (baseline %.4g, %.1f%% slower)\n", \
+                       $1, $4, $2, $3, $5, $7, base[$1 FS $2 FS $3 FS $4 FS $5], 100 * (1 - ratio)
+            }
+        }
+        END {
+            printf "%d of %d measurements regressed by more than %g%% against the baseline\n", \
+                   regressed, compared, 100 * tolerance
+            exit regressed > 0
+        }' "$baseline" "$results"
+fi
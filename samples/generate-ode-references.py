@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+
+# Generates the *-ode-out.mr references that mountainsolve's adaptive integrator (SOLVER_INTEGRATOR=adaptive) is tested
+# against: each *-in.mr named on the command line is solved as the ODE dh/dt = r - h^3 + laplacian(h), to a far tighter
+# tolerance than the integrator's default, stopping where the steepness derivative falls to eps(Float64) as
+# Mountains.jl's solve_diffeq.jl does. The math mirrors Mountains.jl (growthrate!, gradient, laplacian, and dsteepness)
+# rather than the C++ code, so the references are independent of the integrator they check; the DifferentialEquations
+# code at the end of Mountains.jl/examples/generatesamples.jl does the same in Julia.
+
+# Requires numpy and scipy.
+
+# Example, from the samples directory:
+# python3 generate-ode-references.py 1d-tiny-in.mr 2d-tiny-in.mr
+
+import sys
+import numpy as np
+from scipy.integrate import solve_ivp
+
+
+# Read a mountain range file, returning its simulation time, uplift rate, and height (in C order, as stored)
+def read_range(filename):
+    with open(filename, "rb") as f:
+        ndims = int(np.fromfile(f, np.uint64, 1)[0])
+        dims = tuple(int(d) for d in np.fromfile(f, np.uint64, ndims))
+        t = float(np.fromfile(f, np.float64, 1)[0])
+        cells = int(np.prod(dims))
+        r = np.fromfile(f, np.float64, cells).reshape(dims)
+        h = np.fromfile(f, np.float64, cells).reshape(dims)
+    return t, r, h
+
+
+# Write a mountain range file in the same format
+def write_range(filename, t, r, h):
+    with open(filename, "wb") as f:
+        np.array([r.ndim, *r.shape], np.uint64).tofile(f)
+        np.array([t], np.float64).tofile(f)
+        r.astype(np.float64).tofile(f)
+        h.astype(np.float64).tofile(f)
+
+
+# Slices selecting the interior cells shifted by offset along axis a
+def shifted(ndim, a, offset):
+    return tuple(slice(1+offset, -1+offset or None) if b == a else slice(1, -1) for b in range(ndim))
+
+
+interior = lambda ndim: (slice(1, -1),) * ndim
+
+
+# Growth rate r - h^3 + laplacian(h) in the interior; the edges of a 1-D range copy their neighbors, and the boundary of
+# a multi-dimensional range stays 0 (growthrate! only copies the first and last cells, whose neighbors are boundary)
+def growthrate(h, r):
+    g = np.zeros_like(h)
+    i = interior(h.ndim)
+    L = -h.ndim * h[i]
+    for a in range(h.ndim):
+        L = L + (h[shifted(h.ndim, a, -1)] + h[shifted(h.ndim, a, 1)]) / 2
+    g[i] = r[i] - h[i]**3 + L
+    flat = g.reshape(-1)
+    flat[0], flat[-1] = flat[1], flat[-2]
+    return g
+
+
+# Mountains.jl's gradient: the sum over axes of the central differences, halved
+def gradient(x):
+    return sum(x[shifted(x.ndim, a, 1)] - x[shifted(x.ndim, a, -1)] for a in range(x.ndim)) / 2
+
+
+def dsteepness(h, g):
+    return 2 * np.sum(gradient(h) * gradient(g)) / (h.size - 2)
+
+
+for infile in sys.argv[1:]:
+    t0, r, h0 = read_range(infile)
+    shape = h0.shape
+    rhs = lambda t, h: growthrate(h.reshape(shape), r).reshape(-1)
+    stop = lambda t, h: dsteepness(h.reshape(shape), growthrate(h.reshape(shape), r)) - np.finfo(np.float64).eps
+    stop.terminal, stop.direction = True, -1
+    sol = solve_ivp(rhs, (t0, 10000), h0.reshape(-1), method="DOP853", rtol=1e-12, atol=1e-12, events=stop)
+    t, h = sol.t_events[0][0], sol.y_events[0][0].reshape(shape)
+    outfile = infile.replace("-in.mr", "-ode-out.mr")
+    write_range(outfile, t, r, h)
+    print(f"{outfile}: simulation time {float(t)!r} after {sol.nfev} evaluations")
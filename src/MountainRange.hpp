@@ -1,5 +1,9 @@
 #pragma once
 #include <vector>
+#include <array>
+#include <functional>
+#include <memory>
+#include <span>
 #include <fstream>
 #include <filesystem>
 #include <charconv>
@@ -7,7 +11,16 @@
 #include <cstring>
 #include <cmath>
 #include <limits>
+#include <algorithm>
+#include <ranges>
+#include <future>
+#include <optional>
+#include <tuple>
+#include <type_traits>
 #include "binary_io.hpp"
+#include "kernels.hpp"
+#include "mapped_file.hpp"
+#include "profile.hpp"
 
 
 
@@ -32,50 +45,168 @@ namespace mr {
         }
         return std::array{first, last};
     }
+
+
+
+    // Allocator that leaves new elements uninitialized, so that the memory behind a freshly sized vector isn't touched
+    // until it's first written; the thread that touches a page first determines which NUMA node it lives on
+    template <class T>
+    struct default_init_allocator: std::allocator<T> {
+        template <class U> struct rebind { using other = default_init_allocator<U>; };
+        default_init_allocator() = default;
+        template <class U> default_init_allocator(const default_init_allocator<U> &) noexcept {}
+        template <class U> void construct(U *p) noexcept { ::new(static_cast<void *>(p)) U; }
+        template <class U, class... Args> void construct(U *p, Args &&...args) {
+            ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...);
+        }
+    };
 }
 
 
 
-// Base MountainRange. Derived classes can override write, dsteepness, and step.
+// Base MountainRange. Derived classes pass themselves as Derived (the curiously recurring template pattern) and can
+// replace write, dsteepness, step, and the other functions solving is built from; the solve loops call those through
+// self(), so each implementation's loop is compiled for it alone, with no virtual calls in the way of inlining.
+//
+// Ranges can have up to 16 dimensions, stored in C order (the last axis is contiguous), like Mountains.jl reads and
+// writes them. One-dimensional ranges get the fused and temporally blocked sweeps below; ranges of more dimensions are
+// stepped a tile at a time (see for_each_grid_row) with the same math as Mountains.jl: the Laplacian sums over every
+// axis, and g stays 0 on the boundary, so h never changes there.
+//
+// r, h, and g are stored as T, which can be float to halve the memory traffic of stepping. Time, the steepness
+// derivative, and mountain range files are always double precision; ranges are converted as they're read and written.
+template <class T=double, class Derived=void>
 class MountainRange {
 public:
-    using size_type  = size_t;
-    using value_type = double;
+    using size_type    = size_t;
+    using value_type   = double;
+    using storage_type = T;
+    using array_type   = std::vector<storage_type, mr::default_init_allocator<storage_type>>;
+
+
+
+    // Help message describing the environment variables that affect solve
+    inline static const std::string help_message =
+            "Set the environment variable SOLVER_STEPS_PER_SWEEP to a positive integer to take that many steps per pass "
+            "through memory (default 1; one-dimensional ranges only).\n"
+            "Set the environment variable SOLVER_SIMD to scalar or avx2 to avoid wider SIMD kernels (using " +
+            std::string(mr::kernels::active<storage_type>.name) + ").\n"
+            "Set the environment variable SOLVER_MMAP to 1 to use the uplift rate straight from the input file mapped "
+            "into memory and to write output through mapped files.\n"
+            "Set the environment variable SOLVER_DS_INTERVAL to a positive integer to check the steepness derivative "
+            "only every so many steps, up to that many apart depending on how fast it's falling, bisecting back to the "
+            "exact step where it reaches 0 (default 1, checking every step).\n"
+            "Set the environment variable SOLVER_INTEGRATOR to adaptive to solve the underlying differential equation "
+            "with an adaptive 5th order Runge-Kutta method instead of steps of 0.01, stopping at the time the "
+            "steepness derivative reaches 0 (default euler); SOLVER_TOLERANCE sets the error allowed per step relative "
+            "to the size of h (default 1e-8)." +
+            std::string(std::is_same_v<storage_type, value_type> ? "" :
+            "\nRanges are stored in single precision here, in which the steepness derivative levels off well above "
+            "double precision's epsilon, so solving stops once it falls to single precision's epsilon instead. That's "
+            "early enough (e.g. simulation time 7.27 rather than 10.01 for samples/1d-small-in.mr) that only the "
+            "smallest ranges come out within mountaindiff's tolerances.");
 
 
 
 protected:
     // Parameters and members
     static constexpr const value_type default_dt = 0.01;
-    static constexpr const size_t header_size = sizeof(size_type) * 2 + sizeof(value_type);
-    const size_type ndims, cells;
+    static constexpr const size_type max_ndims = 16; // as in Mountains.jl
+    static constexpr const size_type block_size         = 1 << 14; // cells per block handed to an OpenMP thread
+    static constexpr const size_type fused_tile_size    = 1 << 10; // cells per tile in fused_sweep
+    static constexpr const size_type temporal_tile_size = 1 << 12; // cells per tile in temporal_sweep
+    static constexpr const size_type conversion_size    = 1 << 16; // values converted at a time when reading or writing
+    static constexpr const size_type grid_tile_size     = 1 << 12; // cells per tile of a plane of an N-D range
+    static constexpr const size_type grid_row_size      = 1 << 9;  // longest row of such a tile
+    static constexpr const size_type grid_block_planes  = 1 << 4;  // planes per block handed to an OpenMP thread
+    // Solving stops once ds falls to this. In single precision ds levels off around 2e-8 (from 1d-small's t=11 on)
+    // rather than falling to double's epsilon, so solves stop at float's epsilon instead, well before double ones do
+    static constexpr const value_type ds_epsilon = std::numeric_limits<storage_type>::epsilon();
+    const size_type ndims;
+    const std::vector<size_type> dims; // size of each axis
+    const size_type cells;
     value_type t;
-    std::vector<value_type> r, h, g;
+    std::vector<size_type> local_dims;    // size of each axis of the block of cells stored, which is all of them here
+    std::vector<size_type> local_strides; // distance in memory between neighbors along each axis of that block
+    std::vector<size_type> tile_dims;     // size of each axis of a tile of that block (see for_each_grid_row)
+    std::unique_ptr<const mr::mapped_file> input_map; // the input file, if r is used straight from it
+    array_type r_storage;                             // r, unless it's mapped from the input file
+    std::span<const storage_type> r;
+    std::vector<value_type> exact_r;                  // r as read, for writing, if it's stored at lower precision
+    array_type h, g;
+    array_type h_next, g_next; // only allocated if temporal blocking is used
+    value_type snapshot_t;
+    array_type snapshot_h, snapshot_g; // only allocated if ds is checked sparsely
+    value_type rk_start_t = 0;
+    array_type rk_start_h;          // h at the start of an adaptive step; only allocated if integrating adaptively
+    std::array<array_type, 6> rk_k; // g at each stage of an adaptive step but the last (see rk_step)
+    size_type rk_accepted = 0, rk_rejected = 0;
+    value_type checkpoint_t;
+    array_type checkpoint_h;             // copy of h being written by the checkpoint in flight
+    std::future<void> checkpoint_writer; // the checkpoint in flight, if any; declared last so it's waited on first
 
 
 
 public:
     // Accessors
-    auto size()         const { return cells; }
-    auto sim_time()     const { return t; }
-    auto &uplift_rate() const { return r; }
-    auto &height()      const { return h; }
+    auto size()           const { return cells; }
+    auto &dimensions()    const { return dims; }
+    auto sim_time()       const { return t; }
+    auto &uplift_rate()   const { return r; }
+    auto &height()        const { return h; }
+    auto accepted_steps() const { return rk_accepted; } // steps taken by the adaptive integrator
+    auto rejected_steps() const { return rk_rejected; } // steps it retook with a smaller dt
+    static constexpr auto default_time_step() { return default_dt; }
+
+
+    // Implementations that measure memory bandwidth describe it here
+    std::string bandwidth_report() const { return ""; }
+
+
+
+protected:
+    // The implementation being solved, whose versions of the functions solving is built from are the ones called
+    using implementation = std::conditional_t<std::is_void_v<Derived>, MountainRange, Derived>;
+    implementation &self() { return static_cast<implementation &>(*this); }
 
 
 
 protected:
     // Basic constructor
-    MountainRange(auto ndims, auto cells, auto t, const auto &r, const auto &h): ndims{ndims}, cells{cells}, t{t},
-                                                                                 r(r), h(h), g(h) {
-        if (ndims != 1) handle_wrong_dimensions();
+    MountainRange(std::vector<size_type> dims, value_type t, const auto &r, const auto &h):
+            MountainRange(std::move(dims), t) {
+        if (r.size() != cells || h.size() != cells) {
+            throw std::logic_error("Uplift rate and height must have as many cells as the dimensions call for");
+        }
+        r_storage.assign(r.begin(), r.end());
+        this->r = r_storage;
+        this->h.assign(h.begin(), h.end());
+        g.assign(cells, 0);
+        if constexpr (!std::is_same_v<storage_type, value_type>) exact_r.assign(r.begin(), r.end());
+#ifdef _OPENMP
+        if constexpr (std::is_void_v<Derived>) { // derived implementations first touch their own way once constructed
+            first_touch_r();
+            first_touch(this->h);
+            first_touch(this->g);
+        }
+#endif
         step(0); // initialize g
     }
 
 
 
+    // Set up the header and the layout of the cells stored, leaving r, h, and g empty for the caller to fill in
+    MountainRange(std::vector<size_type> dims, value_type t): ndims{dims.size()}, dims{std::move(dims)},
+                                                              cells{check_dimensions(this->dims)}, t{t} {
+        set_local_dims(this->dims);
+    }
+
+
+
     // Error handlers for I/O constructors
     static void handle_wrong_dimensions() {
-        throw std::logic_error("Input file is corrupt or multi-dimensional, which this implementation doesn't support");
+        throw std::logic_error("Input file is corrupt or has more dimensions than this implementation supports (" +
+                               std::to_string(max_ndims) + ")");
     }
 
     static void handle_wrong_file_size() {
@@ -92,19 +223,119 @@ protected:
 
 
 
-    // Read in a MountainRange from a stream
-    MountainRange(std::istream &&s): ndims{try_read_bytes<decltype(ndims)>(s)},
-                                     cells{try_read_bytes<decltype(cells)>(s)},
-                                     t{    try_read_bytes<decltype(t    )>(s)},
-                                     r(cells),
-                                     h(cells),
-                                     g(cells) {
-        // Handle nonsense
-        if (ndims != 1) handle_wrong_dimensions();
+    // Size of the header of a file holding a range with ndims dimensions
+    static constexpr size_t header_size(size_type ndims) {
+        return sizeof(size_type) * (1 + ndims) + sizeof(value_type);
+    }
+
+    // Read a range's dimensions from the stream after its dimension count, which is checked first
+    static std::vector<size_type> read_dimensions(std::istream &s, size_type ndims) {
+        if (ndims < 1 || ndims > max_ndims) handle_wrong_dimensions();
+        std::vector<size_type> dims(ndims);
+        try_read_bytes(s, dims.data(), dims.size());
+        return dims;
+    }
+
+    // Make sure a range has a supported number of dimensions, and return its number of cells
+    static size_type check_dimensions(const std::vector<size_type> &dims) {
+        if (dims.size() < 1 || dims.size() > max_ndims) handle_wrong_dimensions();
+        size_type cells = 1;
+        for (auto d: dims) cells *= d;
+        return cells;
+    }
+
+
+
+    // Map an input file into memory if SOLVER_MMAP=1
+    static std::unique_ptr<const mr::mapped_file> map_if_requested(const char *filename) {
+        return mr::mmap_requested() ? std::make_unique<const mr::mapped_file>(filename) : nullptr;
+    }
+
+
+
+    // r as it was read, which is r itself unless it's stored at lower precision
+    std::span<const value_type> r_to_write() const {
+        if constexpr (std::is_same_v<storage_type, value_type>) {
+            return r;
+        } else {
+            return exact_r;
+        }
+    }
+
+    // Read n doubles from s into x, converting them a chunk at a time if x isn't double
+    static void read_values(std::istream &s, storage_type *x, size_type n) {
+        if constexpr (std::is_same_v<storage_type, value_type>) {
+            try_read_bytes(s, x, n);
+        } else {
+            std::vector<value_type> buffer(std::min(n, conversion_size));
+            for (size_type i=0; i<n; i+=buffer.size()) {
+                auto m = std::min(buffer.size(), n-i);
+                try_read_bytes(s, buffer.data(), m);
+                std::copy(buffer.begin(), buffer.begin()+m, x+i);
+            }
+        }
+    }
+
+    // Hand x[0, n) to put as doubles, converting them a chunk at a time if x isn't double
+    static void put_values(const storage_type *x, size_type n, auto put) {
+        if constexpr (std::is_same_v<storage_type, value_type>) {
+            put(x, n);
+        } else {
+            std::vector<value_type> buffer(std::min(n, conversion_size));
+            for (size_type i=0; i<n; i+=buffer.size()) {
+                auto m = std::min(buffer.size(), n-i);
+                std::copy(x+i, x+i+m, buffer.begin());
+                put(buffer.data(), m);
+            }
+        }
+    }
+
+
+
+    // Read in a MountainRange from a stream. If the file is also mapped into memory, r is used straight from the mapping
+    // (unless it has to be converted) and h is copied from it, skipping the stream's buffer.
+    MountainRange(std::istream &&s, std::unique_ptr<const mr::mapped_file> map=nullptr):
+            ndims{try_read_bytes<decltype(ndims)>(s)},
+            dims{read_dimensions(s, ndims)},
+            cells{check_dimensions(dims)},
+            t{try_read_bytes<decltype(t)>(s)},
+            input_map(std::move(map)),
+            r_storage(input_map ? 0 : cells),
+            h(cells),
+            g(cells, 0) {
+        set_local_dims(dims);
 
         // Read in r and h
-        try_read_bytes(s, r.data(), r.size());
-        try_read_bytes(s, h.data(), h.size());
+        if (input_map) {
+            if (input_map->size() != header_size(ndims) + 2 * sizeof(value_type) * cells) handle_wrong_file_size();
+            auto body = reinterpret_cast<const value_type *>(input_map->data() + header_size(ndims));
+            std::copy(body+cells, body+2*cells, h.begin());
+            if constexpr (std::is_same_v<storage_type, value_type>) {
+                r = std::span(body, cells);
+            } else {
+                exact_r.assign(body, body+cells);
+                r_storage.assign(body, body+cells);
+                r = r_storage;
+                input_map.reset();
+            }
+        } else {
+            if constexpr (std::is_same_v<storage_type, value_type>) {
+                try_read_bytes(s, r_storage.data(), r_storage.size());
+            } else {
+                exact_r.resize(cells);
+                try_read_bytes(s, exact_r.data(), exact_r.size());
+                r_storage.assign(exact_r.begin(), exact_r.end());
+            }
+            read_values(s, h.data(), h.size());
+            r = r_storage;
+        }
+#ifdef _OPENMP
+        if constexpr (std::is_void_v<Derived>) { // derived implementations first touch their own way once constructed
+            first_touch_r();
+            first_touch(h);
+            first_touch(g);
+        }
+#endif
 
         // Initialize g
         step(0);
@@ -114,12 +345,13 @@ protected:
 
 public:
     // Build a MountainRange from an uplift rate and a current height
-    MountainRange(const auto &r, const auto &h): MountainRange(1ul, r.size(), 0.0, r, h) {}
+    MountainRange(const std::ranges::range auto &r, const std::ranges::range auto &h):
+            MountainRange({size_type(std::ranges::size(r))}, 0.0, r, h) {}
 
 
 
     // Read a MountainRange from a file, handling read errors gracefully
-    MountainRange(const char *filename) try: MountainRange(std::ifstream(filename)) {
+    MountainRange(const char *filename) try: MountainRange(std::ifstream(filename), map_if_requested(filename)) {
                                         } catch (const std::ios_base::failure &e) {
                                             handle_read_failure(filename);
                                         } catch (const std::filesystem::filesystem_error &e) {
@@ -129,17 +361,151 @@ public:
 
 
     // Write a MountainRange to a file, handling write errors gracefully
-    virtual void write(const char *filename) const {
+    void write(const char *filename) const {
+        write(filename, t, h);
+    }
+
+
+
+    // Read the range in a file into this one's memory in place of its state, so that a long-running solver can reuse
+    // the threads and buffers already set up for a range of the same shape. Returns false, changing nothing, if the
+    // file's range is shaped differently; only for implementations that store every cell.
+    bool reload(const char *filename) {
+        self().finish_checkpoint();
+        try {
+            auto s = std::ifstream(filename);
+            auto file_ndims = try_read_bytes<size_type>(s);
+            if (file_ndims != ndims || read_dimensions(s, file_ndims) != dims) return false;
+            auto file_t = try_read_bytes<value_type>(s);
+            if (input_map) { // r can't be read into the mapping, so it gets memory of its own from now on
+                input_map.reset();
+                r_storage = array_type(cells);
+                self().first_touch(r_storage);
+            }
+            if constexpr (std::is_same_v<storage_type, value_type>) {
+                try_read_bytes(s, r_storage.data(), cells);
+            } else {
+                try_read_bytes(s, exact_r.data(), cells);
+                std::copy(exact_r.begin(), exact_r.end(), r_storage.begin());
+            }
+            read_values(s, h.data(), cells);
+            t = file_t;
+        } catch (const std::ios_base::failure &e) {
+            handle_read_failure(filename);
+        }
+        r = r_storage;
+        std::fill(g.begin(), g.end(), 0);
+        rk_accepted = rk_rejected = 0;
+        self().step(0); // initialize g
+        return true;
+    }
+
+
+
+    // Name of the checkpoint file that solve writes at time t
+    static std::string checkpoint_name(value_type t) {
+        return std::format("chk-{:07.2f}.wo", t);
+    }
+
+
+
+    // Find the newest checkpoint in the current directory that solving the mountain range in filename could have
+    // written, or filename itself if there isn't one. A checkpoint is only trusted if it's complete, has the same
+    // dimensions and r, and has finite h at a later time. g isn't stored, but it's a function of r and h, so the
+    // checkpoint's step(0) restores the full solver state.
+    static std::string latest_checkpoint(const char *filename) {
+        // Read t, dimensions, r, and h from a file, or nothing if it can't be read or is the wrong size
+        using file_array = std::vector<value_type>;
+        using file_state = std::tuple<value_type, std::vector<size_type>, file_array, file_array>;
+        auto read_state = [](const std::filesystem::path &path) -> std::optional<file_state> {
+            try {
+                auto s = std::ifstream(path);
+                auto file_ndims = try_read_bytes<size_type>(s);
+                if (file_ndims < 1 || file_ndims > max_ndims) return std::nullopt;
+                auto file_dims  = read_dimensions(s, file_ndims);
+                auto file_cells = check_dimensions(file_dims);
+                auto file_t     = try_read_bytes<value_type>(s);
+                auto expected_size = header_size(file_ndims) + 2 * sizeof(value_type) * file_cells;
+                if (std::filesystem::file_size(path) != expected_size) return std::nullopt;
+                auto file_r = file_array(file_cells), file_h = file_array(file_cells);
+                try_read_bytes(s, file_r.data(), file_r.size());
+                try_read_bytes(s, file_h.data(), file_h.size());
+                return file_state{file_t, std::move(file_dims), std::move(file_r), std::move(file_h)};
+            } catch (const std::ios_base::failure &e) {
+                return std::nullopt;
+            } catch (const std::filesystem::filesystem_error &e) {
+                return std::nullopt;
+            }
+        }; // https://tinyurl.com/byusc-lambda
+        auto original = read_state(filename);
+        if (!original) handle_read_failure(filename);
+        auto &[original_t, original_dims, original_r, original_h] = *original; // https://tinyurl.com/byusc-structbind
+
+        // Gather checkpoints, newest first; names only get longer once t passes 9999.99
+        std::vector<std::filesystem::path> checkpoints;
+        for (auto &entry: std::filesystem::directory_iterator(".")) {
+            auto name = entry.path().filename().string();
+            if (name.starts_with("chk-") && name.ends_with(".wo")) checkpoints.push_back(entry.path());
+        }
+        std::ranges::sort(checkpoints, std::ranges::greater{}, [](const auto &path){
+            return std::pair{path.native().size(), path.native()};
+        }); // https://tinyurl.com/byusc-lambda
+
+        // Return the first one that checks out
+        for (const auto &path: checkpoints) {
+            auto candidate = read_state(path);
+            if (!candidate) continue;
+            auto &[candidate_t, candidate_dims, candidate_r, candidate_h] = *candidate;
+            if (candidate_t > original_t && candidate_dims == original_dims &&
+                    std::ranges::equal(candidate_r, original_r) &&
+                    std::ranges::all_of(candidate_h, [](auto x){ return std::isfinite(x); })) {
+                return path.string();
+            }
+        }
+        return filename;
+    }
+
+
+
+protected:
+    // Write a MountainRange with the given time and height to a file; used directly to write checkpoints from a copy.
+    // The file is written through a mapping if SOLVER_MMAP=1.
+    void write(const char *filename, value_type time, const array_type &height) const {
+        MR_PROFILE_SCOPE(write, header_size(ndims) + 2.0 * sizeof(value_type) * cells);
+
+        // Write through a mapping if requested
+        if (mr::mmap_requested()) {
+            try {
+                auto f = mr::mapped_file(filename, header_size(ndims) + 2 * sizeof(value_type) * cells);
+                auto out = f.data();
+                auto put_bytes = [&out](const auto *p, size_t n){
+                    std::memcpy(out, p, sizeof(*p) * n);
+                    out += sizeof(*p) * n;
+                }; // https://tinyurl.com/byusc-lambda
+                put_bytes(&ndims, 1);
+                put_bytes(dims.data(), ndims);
+                put_bytes(&time, 1);
+                put_bytes(r_to_write().data(), cells);
+                put_values(height.data(), height.size(), put_bytes);
+                f.commit();
+            } catch (const std::filesystem::filesystem_error &e) {
+                handle_write_failure(filename);
+            }
+            return;
+        }
+
         // Open the file
         auto f = std::ofstream(filename);
 
         try {
             // Write the header
-            try_write_bytes(f, &ndims, &cells, &t);
+            try_write_bytes(f, &ndims);
+            try_write_bytes(f, dims.data(), ndims);
+            try_write_bytes(f, &time);
 
             // Write the body
-            try_write_bytes(f, r.data(), r.size());
-            try_write_bytes(f, h.data(), h.size());
+            try_write_bytes(f, r_to_write().data(), cells);
+            put_values(height.data(), height.size(), [&f](const value_type *p, size_t n){ try_write_bytes(f, p, n); });
 
         // Handle write failures
         } catch (const std::filesystem::filesystem_error &e) {
@@ -151,43 +517,407 @@ public:
 
 
 
-protected:
-    // Helpers for step and dsteepness
-    constexpr void update_g_cell(auto i) {
+    // Start writing a checkpoint in the background so that stepping can continue while it's written. The state is
+    // copied first; if the last checkpoint is still being written, wait for it before overwriting its copy.
+    void start_checkpoint(const std::string &filename) {
+        self().finish_checkpoint();
+        MR_PROFILE_SCOPE(checkpoint);
+        checkpoint_t = t;
+        checkpoint_h.assign(h.begin(), h.end());
+        checkpoint_writer = std::async(std::launch::async, [this, filename]{
+            write(filename.c_str(), checkpoint_t, checkpoint_h);
+        }); // https://tinyurl.com/byusc-lambda
+    }
+
+
+
+    // Wait for the checkpoint in flight, if any, to be written, rethrowing any error from writing it
+    void finish_checkpoint() {
+        if (!checkpoint_writer.valid()) return; // not profiled, so runs without checkpoints show no checkpoint phase
+        MR_PROFILE_SCOPE(checkpoint);
+        checkpoint_writer.get();
+    }
+
+
+
+    // Helpers for step and dsteepness. The versions that take pointers work on any copy of part of r, h, and g, as long
+    // as i is relative to the start of the copy.
+    constexpr storage_type g_cell(const storage_type *r, const storage_type *h, auto i) const {
         auto L = (h[i-1] + h[i+1]) / 2 - h[i];
-        g[i] = r[i] - pow(h[i], 3) + L;
+        return r[i] - h[i]*h[i]*h[i] + L;
+    }
+
+    constexpr storage_type g_cell(auto i) const {
+        return g_cell(r.data(), h.data(), i);
+    }
+
+    constexpr void update_g_cell(auto i) {
+        g[i] = g_cell(i);
     }
 
     constexpr void update_h_cell(auto i, auto dt) {
         h[i] += g[i] * dt;
     }
 
+    constexpr value_type ds_cell(const storage_type *h, auto i, auto g_left, auto g_right) const {
+        return ((value_type(h[i-1]) - h[i+1]) * (value_type(g_left) - g_right)) / 2 / (cells - 2);
+    }
+
     constexpr value_type ds_cell(auto i) const {
-        return ((h[i-1] - h[i+1]) * (g[i-1] - g[i+1])) / 2 / (cells - 2);
+        return ds_cell(h.data(), i, g[i-1], g[i+1]);
+    }
+
+
+
+    // Vectorized versions of the helpers above over cells [first, last)
+    void update_g_cells(const storage_type *r, const storage_type *h, storage_type *g, size_type first,
+                        size_type last) const {
+        mr::kernels::active<storage_type>.update_g(r, h, g, first, last);
+    }
+
+    void update_g_cells(size_type first, size_type last) {
+        update_g_cells(r.data(), h.data(), g.data(), first, last);
+    }
+
+    void update_h_cells(storage_type *h_out, const storage_type *h, const storage_type *g, size_type first,
+                        size_type last, value_type dt) const {
+        mr::kernels::active<storage_type>.update_h(h_out, h, g, first, last, dt);
+    }
+
+    void update_h_cells(size_type first, size_type last, value_type dt) {
+        update_h_cells(h.data(), h.data(), g.data(), first, last, dt);
+    }
+
+    value_type ds_cells(const storage_type *h, const storage_type *g, size_type first, size_type last) const {
+        return mr::kernels::active<storage_type>.ds_sum(h, g, first, last) / 2 / (cells - 2);
+    }
+
+    value_type ds_cells(size_type first, size_type last) const {
+        return ds_cells(h.data(), g.data(), first, last);
+    }
+
+
+
+    // Blocks of cells handed to OpenMP threads
+    size_type block_count() const {
+        return (h.size() + block_size - 1) / block_size;
+    }
+
+    auto block_range(size_type b) const {
+        return std::array{b*block_size, std::min((b+1)*block_size, h.size())};
+    }
+
+
+
+    // Replace x with a copy whose pages are first touched by the OpenMP thread that handles each block, so that on a
+    // multi-socket node each thread works on memory attached to its own socket.
+    void first_touch(array_type &x) {
+        array_type fresh(x.size()); // not touched yet
+        #pragma omp parallel for schedule(static)
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b); // https://tinyurl.com/byusc-structbind
+            std::copy(x.begin()+first, x.begin()+last, fresh.begin()+first);
+        }
+        x.swap(fresh);
+    }
+
+
+
+    // Call F(first, last) on blocks of cells covering every cell stored, in parallel, and return the largest value it
+    // returns; used for the adaptive integrator's arithmetic on whole arrays
+    value_type parallel_max(const std::function<value_type(size_type, size_type)> &F) {
+        value_type result = 0;
+        #pragma omp parallel for schedule(static) reduction(max:result)
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b); // https://tinyurl.com/byusc-structbind
+            result = std::max(result, F(first, last));
+        }
+        return result;
+    }
+
+    // The largest of x over every process
+    value_type global_max(value_type x) {
+        return x;
+    }
+
+
+
+    // Move r like first_touch, then point r at it; r isn't moved if it's mapped from the input file, whose pages belong
+    // to the page cache
+    void first_touch_r() {
+        if (input_map) return;
+        self().first_touch(r_storage);
+        r = r_storage;
+    }
+
+
+
+    // Lay out the block of cells stored as local_dims, and choose the tiles it's swept in: rows of up to grid_row_size
+    // cells along the last axis, stacked along the axes before it (but not the first) up to grid_tile_size cells
+    void set_local_dims(const std::vector<size_type> &new_local_dims) {
+        local_dims = new_local_dims;
+        local_strides.assign(ndims, 1);
+        for (auto a=ndims-1; a>0; a--) local_strides[a-1] = local_strides[a] * local_dims[a];
+        tile_dims.assign(ndims, 1);
+        size_type tile_cells = 1;
+        for (auto a=ndims-1; a>0; a--) {
+            auto limit = a == ndims-1 ? grid_row_size : grid_tile_size / tile_cells;
+            auto interior = local_dims[a] > 2 ? local_dims[a] - 2 : 1;
+            tile_dims[a] = std::clamp(interior, size_type{1}, limit);
+            tile_cells *= tile_dims[a];
+        }
+    }
+
+
+
+    // Number of tiles, which cover the interior cells of every axis but the first of the block of cells stored
+    size_type grid_tile_count() const {
+        size_type count = 1;
+        for (size_type a=1; a<ndims; a++) {
+            if (local_dims[a] < 3) return 0;
+            count *= (local_dims[a] - 2 + tile_dims[a] - 1) / tile_dims[a];
+        }
+        return local_dims[0] < 3 ? 0 : count;
+    }
+
+    // Call F(i, n) for each row of interior cells of a tile on planes [plane_first, plane_last) of the first axis,
+    // where i is the index of the row's first cell and n is how many cells it has. Rows are visited in memory order,
+    // so a plane of the tile is still in cache when it's needed as the neighbor of the next plane.
+    void for_each_grid_row(size_type tile, size_type plane_first, size_type plane_last, auto F) const {
+        // Find the tile's interior cells along each axis but the first
+        std::array<size_type, max_ndims> lo{}, hi{}, index{};
+        for (auto a=ndims-1; a>0; a--) {
+            auto tiles = (local_dims[a] - 2 + tile_dims[a] - 1) / tile_dims[a];
+            lo[a] = 1 + tile % tiles * tile_dims[a];
+            hi[a] = std::min(lo[a] + tile_dims[a], local_dims[a] - 1);
+            tile /= tiles;
+        }
+
+        // Visit each row, counting through the axes between the first and last like an odometer
+        auto row_length = hi[ndims-1] - lo[ndims-1];
+        for (auto p=std::max(plane_first, size_type{1}); p<std::min(plane_last, local_dims[0]-1); p++) {
+            std::copy(lo.begin(), lo.begin()+ndims, index.begin());
+            while (true) {
+                auto i = p * local_strides[0] + lo[ndims-1];
+                for (size_type a=1; a+1<ndims; a++) i += index[a] * local_strides[a];
+                F(i, row_length);
+                auto a = ndims-1;
+                while (--a > 0 && ++index[a] == hi[a]) index[a] = lo[a];
+                if (a == 0) break;
+            }
+        }
+    }
+
+    // Blocks of tiles handed to OpenMP threads: a tile over a run of grid_block_planes planes
+    size_type grid_block_count() const {
+        return grid_tile_count() * ((local_dims[0] + grid_block_planes - 1) / grid_block_planes);
+    }
+
+    auto grid_block(size_type b) const {
+        auto tiles = grid_tile_count(), planes = b / tiles * grid_block_planes;
+        return std::array{b % tiles, planes, std::min(planes + grid_block_planes, local_dims[0])};
+    }
+
+    // Number of interior cells in a block, for profiling
+    double grid_block_cells(size_type b) const {
+        auto [tile, plane_first, plane_last] = grid_block(b); // https://tinyurl.com/byusc-structbind
+        size_type n = 0;
+        for_each_grid_row(tile, plane_first, plane_last, [&n](auto, auto row_length){ n += row_length; });
+        return n;
+    }
+
+
+
+    // Update g, or return the sum of ds, over the interior cells of a tile on planes [plane_first, plane_last)
+    void update_g_grid(size_type tile, size_type plane_first, size_type plane_last) {
+        for_each_grid_row(tile, plane_first, plane_last, [this](auto i, auto n){
+            mr::kernels::update_g_grid(r.data(), h.data(), g.data(), i, i+n, local_strides.data(), ndims);
+        }); // https://tinyurl.com/byusc-lambda
+    }
+
+    value_type ds_grid(size_type tile, size_type plane_first, size_type plane_last) const {
+        value_type ds = 0;
+        for_each_grid_row(tile, plane_first, plane_last, [this, &ds](auto i, auto n){
+            ds += mr::kernels::ds_sum_grid(h.data(), g.data(), i, i+n, local_strides.data(), ndims);
+        });
+        return ds / 2 / (cells - 2);
+    }
+
+    // The same over every tile
+    void update_g_grid(size_type plane_first, size_type plane_last) {
+        for (size_type tile=0; tile<grid_tile_count(); tile++) update_g_grid(tile, plane_first, plane_last);
+    }
+
+    value_type ds_grid(size_type plane_first, size_type plane_last) const {
+        value_type ds = 0;
+        for (size_type tile=0; tile<grid_tile_count(); tile++) ds += ds_grid(tile, plane_first, plane_last);
+        return ds;
+    }
+
+
+
+    // Update h on [first, last) and g on [first+1, last-1), returning the sum of ds_cell on [first+2, last-2). The
+    // range is swept in tiles small enough to stay in L1 cache: each tile updates h, then the cells of g whose right
+    // neighbor in h is now updated, then the cells of ds whose right neighbor in g is now updated. This way r, h, and g
+    // only stream through main memory once rather than three times (step then dsteepness), while each of the three
+    // inner loops stays simple enough to vectorize. The new h and g are written to h_out and g_out, which can be h and
+    // g themselves.
+    value_type fused_sweep(size_type first, size_type last, value_type dt, storage_type *h_out, storage_type *g_out) {
+        value_type ds = 0;
+        for (auto tile_first=first; tile_first<last; tile_first+=fused_tile_size) {
+            auto tile_last = std::min(tile_first+fused_tile_size, last);
+            update_h_cells(h_out, h.data(), g.data(), tile_first, tile_last, dt);
+            update_g_cells(r.data(), h_out, g_out, std::max(tile_first, first+2)-1, tile_last-1);
+            ds += ds_cells(h_out, g_out, std::max(tile_first, first+4)-2, std::max(tile_last, size_type{2})-2);
+        }
+        return ds;
+    }
+
+    value_type fused_sweep(size_type first, size_type last, value_type dt) {
+        return fused_sweep(first, last, dt, h.data(), g.data());
+    }
+
+
+
+    // Finish what fused_sweep(first, last, dt) left undone once every block's sweep is done: the edge cells of g, the
+    // boundary condition, and the edge cells of ds. Neighboring blocks' edges might not have been written yet, so
+    // edge values of g are recomputed from h rather than read; this way blocks never need to wait on each other.
+    value_type fused_sweep_edges(size_type first, size_type last) {
+        if (first == last) return 0;
+        auto new_g = [this](size_type i){ return g_cell(std::clamp(i, size_type{1}, cells-2)); };
+        auto lo = std::max(first, size_type{1}), hi = std::min(last, cells-1);
+
+        // g on [lo, hi) wasn't updated near first and last
+        for (auto i=lo; i<std::min(first+1, hi); i++) g[i] = new_g(i);
+        for (auto i=std::max({lo, first+1, last-1}); i<hi; i++) g[i] = new_g(i);
+
+        // Enforce boundary condition
+        if (first == 0)    g[0]       = new_g(0);
+        if (last == cells) g[cells-1] = new_g(cells-1);
+
+        // ds on [lo, hi) wasn't computed near first and last
+        value_type ds = 0;
+        for (auto i=lo; i<std::min(first+2, hi); i++) ds += ds_cell(h.data(), i, new_g(i-1), new_g(i+1));
+        for (auto i=std::max({lo+2, first+4, last})-2; i<hi; i++) {
+            ds += ds_cell(h.data(), i, new_g(i-1), new_g(i+1));
+        }
+        return ds;
+    }
+
+
+
+    // Advance the cells in [first, last) nsteps steps of dt, reading h and g and writing h_next and g_next, and add the ds
+    // of those cells after each step to ds[0, nsteps). Each step shrinks the valid part of a copy by a cell on each side,
+    // so the tile is copied into lh and lg along with nsteps+1 cells on either side; all nsteps steps then happen in
+    // cache, at the cost of redundantly recomputing the overlap with neighboring tiles.
+    void temporal_tile(size_type first, size_type last, value_type dt, size_type nsteps, value_type *ds,
+                       std::vector<storage_type> &lh, std::vector<storage_type> &lg) {
+        if (first == last) return;
+
+        // Copy the tile and its surroundings
+        auto copy_first = first - std::min(first, nsteps+1), copy_last = std::min(last+nsteps+1, cells);
+        auto m = copy_last - copy_first;
+        lh.assign(h.begin()+copy_first, h.begin()+copy_last);
+        lg.assign(g.begin()+copy_first, g.begin()+copy_last);
+        auto lr = r.data() + copy_first;
+
+        // Step, shrinking the valid range [lo, hi) except at the boundaries of the mountain range
+        auto left_edge = copy_first == 0, right_edge = copy_last == cells;
+        auto ds_first = std::max(first, size_type{1}) - copy_first, ds_last = std::min(last, cells-1) - copy_first;
+        size_type lo = 0, hi = m;
+        for (size_type s=0; s<nsteps; s++) {
+            update_h_cells(lh.data(), lh.data(), lg.data(), lo, hi, dt);
+            if (!left_edge)  lo += 1;
+            if (!right_edge) hi -= 1;
+            update_g_cells(lr, lh.data(), lg.data(), std::max(lo, size_type{1}), std::min(hi, m-1));
+            if (left_edge)  lg[0]   = lg[1];
+            if (right_edge) lg[m-1] = lg[m-2];
+            ds[s] += ds_cells(lh.data(), lg.data(), ds_first, ds_last);
+        }
+
+        // Copy the tile out
+        std::copy(lh.begin()+(first-copy_first), lh.begin()+(last-copy_first), h_next.begin()+first);
+        std::copy(lg.begin()+(first-copy_first), lg.begin()+(last-copy_first), g_next.begin()+first);
+    }
+
+
+
+    // Run temporal_tile over the whole mountain range, returning the steepness derivative after each step
+    std::vector<value_type> temporal_sweep(value_type dt, size_type nsteps) {
+        const size_type ntiles = (cells + temporal_tile_size - 1) / temporal_tile_size;
+        std::vector<value_type> tile_ds(ntiles * nsteps);
+        #pragma omp parallel
+        {
+            std::vector<storage_type> lh, lg; // scratch space for each thread
+            #pragma omp for schedule(static)
+            for (size_type b=0; b<ntiles; b++) {
+                auto first = b*temporal_tile_size, last = std::min((b+1)*temporal_tile_size, cells);
+                MR_PROFILE_SCOPE(temporal_sweep, 5.0 * sizeof(storage_type) * (last - first));
+                temporal_tile(first, last, dt, nsteps, tile_ds.data()+b*nsteps, lh, lg);
+            }
+        }
+
+        // Sum in tile order so the result doesn't depend on thread count
+        std::vector<value_type> ds(nsteps);
+        for (size_type b=0; b<ntiles; b++) {
+            for (size_type s=0; s<nsteps; s++) ds[s] += tile_ds[b*nsteps+s];
+        }
+        return ds;
     }
 
 
 
 public:
     // Calculate the steepness derivative
-    virtual value_type dsteepness() {
+    value_type dsteepness() {
         value_type ds = 0;
-        #pragma omp parallel for reduction(+:ds)
-        for (size_t i=1; i<h.size()-1; i++) ds += ds_cell(i);
+        if (ndims > 1) {
+            #pragma omp parallel for schedule(static) reduction(+:ds)
+            for (size_type b=0; b<grid_block_count(); b++) {
+                auto [tile, first, last] = grid_block(b); // https://tinyurl.com/byusc-structbind
+                MR_PROFILE_SCOPE(dsteepness, 2.0 * sizeof(storage_type) * grid_block_cells(b));
+                ds += ds_grid(tile, first, last);
+            }
+            return ds;
+        }
+        #pragma omp parallel for schedule(static) reduction(+:ds)
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b); // https://tinyurl.com/byusc-structbind
+            MR_PROFILE_SCOPE(dsteepness, 2.0 * sizeof(storage_type) * (last - first));
+            ds += ds_cells(std::max(first, size_type{1}), std::min(last, h.size()-1));
+        }
         return ds;
     }
 
 
 
     // Step from t to t+dt in one step
-    virtual value_type step(value_type dt) {
+    value_type step(value_type dt) {
         // Update h
-        #pragma omp parallel for
-        for (size_t i=0; i<h.size(); i++) update_h_cell(i, dt);
+        #pragma omp parallel for schedule(static)
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b);
+            MR_PROFILE_SCOPE(update_h, 3.0 * sizeof(storage_type) * (last - first));
+            update_h_cells(first, last, dt);
+        }
 
-        // Update g
-        #pragma omp parallel for
-        for (size_t i=1; i<g.size()-1; i++) update_g_cell(i);
+        // Update g, leaving it 0 on the boundary of a multi-dimensional range
+        if (ndims > 1) {
+            #pragma omp parallel for schedule(static)
+            for (size_type b=0; b<grid_block_count(); b++) {
+                auto [tile, first, last] = grid_block(b);
+                MR_PROFILE_SCOPE(update_g, 3.0 * sizeof(storage_type) * grid_block_cells(b));
+                update_g_grid(tile, first, last);
+            }
+            t += dt;
+            return t;
+        }
+        #pragma omp parallel for schedule(static)
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b);
+            MR_PROFILE_SCOPE(update_g, 3.0 * sizeof(storage_type) * (last - first));
+            update_g_cells(std::max(first, size_type{1}), std::min(last, g.size()-1));
+        }
 
         // Enforce boundary condition
         g[0] = g[1];
@@ -200,23 +930,357 @@ public:
 
 
 
-    // Step until dsteepness() falls below 0, checkpointing along the way
+    // Equivalent to step(dt) followed by dsteepness(), but with a single pass through memory for one-dimensional ranges
+    value_type step_dsteepness(value_type dt) {
+        if (ndims > 1) {
+            self().step(dt);
+            return self().dsteepness();
+        }
+        value_type ds = 0;
+        #pragma omp parallel reduction(+:ds)
+        {
+            // Sweep each block, then clean up the edges between blocks once all sweeps are done
+            #pragma omp for schedule(static)
+            for (size_type b=0; b<block_count(); b++) {
+                auto [first, last] = block_range(b);
+                MR_PROFILE_SCOPE(fused_sweep, 5.0 * sizeof(storage_type) * (last - first));
+                ds += fused_sweep(first, last, dt);
+            }
+            #pragma omp for schedule(static)
+            for (size_type b=0; b<block_count(); b++) {
+                auto [first, last] = block_range(b);
+                MR_PROFILE_SCOPE(fused_sweep);
+                ds += fused_sweep_edges(first, last);
+            }
+        }
+
+        // Increment time step
+        t += dt;
+        return ds;
+    }
+
+
+
+    // Take up to nsteps steps of dt, stopping after the first one that brings the steepness derivative down to epsilon,
+    // and return the steepness derivative after the last step taken. Multiple steps are taken with temporal blocking,
+    // which leaves h and g untouched until the end; if the stopping criterion is met partway through, the sweep is
+    // simply replayed with fewer steps. Multi-dimensional ranges take one step at a time.
+    value_type multi_step_dsteepness(value_type dt, size_type nsteps) {
+        if (nsteps <= 1 || ndims > 1) return self().step_dsteepness(dt);
+
+        // Sweep and find out how many steps should actually have been taken
+        h_next.resize(cells);
+        g_next.resize(cells);
+        auto ds = self().temporal_sweep(dt, nsteps);
+        auto stop = std::ranges::find_if(ds, [](auto x){ return !(x > ds_epsilon); });
+        auto steps_taken = stop == ds.end() ? nsteps : size_type(stop - ds.begin()) + 1;
+        if (steps_taken < nsteps) ds = self().temporal_sweep(dt, steps_taken);
+
+        // Adopt the new state
+        std::swap(h, h_next);
+        std::swap(g, g_next);
+        for (size_type s=0; s<steps_taken; s++) t += dt;
+        return ds[steps_taken-1];
+    }
+
+
+
+    // Take nsteps steps of dt without needing the steepness derivative after any of them
+    void multi_step(value_type dt, size_type nsteps) {
+        if (nsteps == 0) return;
+        if (ndims > 1) {
+            for (size_type s=0; s<nsteps; s++) self().step(dt);
+            return;
+        }
+        if (nsteps == 1) {
+            self().step_dsteepness(dt);
+            return;
+        }
+        h_next.resize(cells);
+        g_next.resize(cells);
+        self().temporal_sweep(dt, nsteps);
+        std::swap(h, h_next);
+        std::swap(g, g_next);
+        for (size_type s=0; s<nsteps; s++) t += dt;
+    }
+
+
+
+protected:
+    // Save the state, or return to the saved state
+    void save_snapshot() {
+        snapshot_t = t;
+        self().copy_state(h, g, snapshot_h, snapshot_g);
+    }
+
+    void restore_snapshot() {
+        t = snapshot_t;
+        self().copy_state(snapshot_h, snapshot_g, h, g);
+    }
+
+    void copy_state(const array_type &from_h, const array_type &from_g, array_type &to_h, array_type &to_g) {
+        to_h.resize(from_h.size());
+        to_g.resize(from_g.size());
+        #pragma omp parallel for schedule(static)
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b); // https://tinyurl.com/byusc-structbind
+            std::copy(from_h.begin()+first, from_h.begin()+last, to_h.begin()+first);
+            std::copy(from_g.begin()+first, from_g.begin()+last, to_g.begin()+first);
+        }
+    }
+
+
+
+    // Take nsteps steps in sweeps of up to steps_per_sweep, only calculating the steepness derivative after the last
+    // step, and return it. If it's reached epsilon by then, bisect back to the first step where it did: the state from
+    // before the steps is saved, and each probe restores the latest state known to fall short of epsilon and steps
+    // forward from there. Each probe's last step is a step_dsteepness, so every ds compared to epsilon is calculated
+    // exactly as it would be if it were checked every step; this finds the same step as long as ds only reaches epsilon
+    // once within the nsteps steps, which the caller ensures by taking fewer steps as ds approaches epsilon.
+    value_type sparse_multi_step_dsteepness(value_type dt, size_type nsteps, size_type steps_per_sweep) {
+        auto advance = [&](size_type m){
+            for (size_type taken=1; taken<m; taken+=steps_per_sweep) {
+                self().multi_step(dt, std::min(steps_per_sweep, m-taken));
+            }
+            return self().step_dsteepness(dt);
+        };
+        auto reached = [](auto ds){ return !(ds > ds_epsilon); };
+
+        // Step, stopping if ds hasn't reached epsilon
+        save_snapshot();
+        auto ds = advance(nsteps);
+        if (!reached(ds)) return ds;
+
+        // Bisect; ds is short of epsilon after lo steps (the saved state) and has reached it after hi steps
+        size_type lo = 0, hi = nsteps, at = nsteps;
+        while (hi - lo > 1) {
+            auto mid = lo + (hi - lo) / 2;
+            restore_snapshot();
+            auto mid_ds = advance(mid - lo);
+            at = mid;
+            if (reached(mid_ds)) {
+                hi = mid;
+                ds = mid_ds;
+            } else {
+                lo = mid;
+                save_snapshot();
+            }
+        }
+        if (at == lo) ds = advance(1);
+        return ds;
+    }
+
+
+
+    // Butcher tableau of the Dormand-Prince 5(4) pair, the same family as Mountains.jl's default ODE solver. Stage s
+    // of a step of dt evaluates g at h + dt * sum(rk_a[s][j] * k[j]), where k[j] is g at stage j and k[0] is g at the
+    // start of the step. The last stage's h is the step's 5th order result, so g there can be reused as the next
+    // step's k[0]; rk_e weighs each k to get the difference between that result and the embedded 4th order one.
+    static constexpr std::array<std::array<double, 6>, 7> rk_a{{
+        {},
+        {1.0/5},
+        {3.0/40, 9.0/40},
+        {44.0/45, -56.0/15, 32.0/9},
+        {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+        {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+        {35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}}};
+    static constexpr std::array<double, 7> rk_e{71.0/57600, 0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525,
+                                                -1.0/40};
+
+    // Take a step of dt from the state in rk_start_t, rk_start_h, and rk_k[0], leaving the result in t, h, and g, and
+    // return the largest error estimate relative to tolerance. g is evaluated with step(0), so every implementation's
+    // way of updating g (halo exchanges included) works unchanged; each stage's g is swapped into rk_k rather than
+    // copied.
+    value_type rk_step(value_type dt, value_type tolerance) {
+        for (size_type s=1; s<rk_a.size(); s++) {
+            self().parallel_max([&](auto first, auto last){
+                MR_PROFILE_SCOPE(integrator, (s+2.0) * sizeof(storage_type) * (last - first));
+                for (auto i=first; i<last; i++) {
+                    value_type dh = 0;
+                    for (size_type j=0; j<s; j++) dh += rk_a[s][j] * rk_k[j][i];
+                    h[i] = rk_start_h[i] + dt * dh;
+                }
+                return value_type{0};
+            }); // https://tinyurl.com/byusc-lambda
+            self().step(0);
+            if (s < rk_k.size()) std::swap(g, rk_k[s]);
+        }
+        t = rk_start_t + dt;
+        return self().global_max(self().parallel_max([&](auto first, auto last){
+            MR_PROFILE_SCOPE(integrator, 8.0 * sizeof(storage_type) * (last - first));
+            value_type largest = 0;
+            for (auto i=first; i<last; i++) {
+                value_type error = rk_e[6] * g[i];
+                for (size_type j=0; j<rk_k.size(); j++) error += rk_e[j] * rk_k[j][i];
+                value_type y0 = rk_start_h[i], y1 = h[i];
+                auto scale = tolerance * (1 + std::max(std::abs(y0), std::abs(y1)));
+                largest = std::max(largest, std::abs(dt * error) / scale);
+            }
+            return largest;
+        }));
+    }
+
+    // Swap the current state with the start of a step, to begin a step or to undo one
+    void swap_rk_start() {
+        std::swap(t, rk_start_t);
+        std::swap(h, rk_start_h);
+        std::swap(g, rk_k[0]);
+    }
+
+    // Once a step of dt from rk_start brings ds from ds_start (above epsilon) to ds_end (not above it), retake it with
+    // shorter and shorter dt to find when ds reaches epsilon, using the Illinois variant of regula falsi, and leave the
+    // state there. Returns ds there, which is at most epsilon.
+    value_type locate_ds_epsilon(value_type dt, value_type tolerance, value_type ds_start, value_type ds_end) {
+        value_type lo = 0, hi = 1, f_lo = ds_start - ds_epsilon, f_hi = ds_end - ds_epsilon;
+        bool at_hi = true;
+        int last_moved = 0; // -1 if lo moved last, 1 if hi did
+        while ((hi - lo) * dt > 1e-10 * std::max(rk_start_t, value_type{1})) {
+            auto frac = hi - f_hi * (hi - lo) / (f_hi - f_lo);
+            if (!(frac > lo && frac < hi)) frac = lo + (hi - lo) / 2;
+            if (!(frac > lo && frac < hi)) break; // lo and hi are adjacent, as can happen in single precision
+            rk_step(frac * dt, tolerance);
+            auto ds = self().dsteepness();
+            at_hi = !(ds > ds_epsilon);
+            if (at_hi) {
+                hi = frac;
+                f_hi = ds - ds_epsilon;
+                ds_end = ds;
+                if (last_moved == 1) f_lo /= 2;
+                last_moved = 1;
+            } else {
+                lo = frac;
+                f_lo = ds - ds_epsilon;
+                if (last_moved == -1) f_hi /= 2;
+                last_moved = -1;
+            }
+        }
+        if (!at_hi) rk_step(hi * dt, tolerance);
+        return ds_end;
+    }
+
+    // Integrate adaptively from a first step of dt until ds reaches epsilon, checkpointing along the way. Each step's
+    // dt is chosen from the last step's error, and steps whose error is over tolerance are retaken with a smaller dt;
+    // checkpoints are written at exact multiples of the interval by shortening the step that would pass one.
+    value_type solve_adaptive(value_type dt) {
+        value_type tolerance = 1e-8, checkpoint_interval = 0;
+        auto TOLERANCE = std::getenv("SOLVER_TOLERANCE");
+        if (TOLERANCE != nullptr) std::from_chars(TOLERANCE, TOLERANCE+std::strlen(TOLERANCE), tolerance);
+        auto INTVL = std::getenv("INTVL");
+        if (INTVL != nullptr) std::from_chars(INTVL, INTVL+std::strlen(INTVL), checkpoint_interval);
+
+        // Make room for the stages, starting from copies of g so that cells step leaves alone (the boundary of a
+        // multi-dimensional range) hold the right values
+        rk_start_h = h;
+        self().first_touch(rk_start_h);
+        for (auto &k: rk_k) {
+            k = g;
+            self().first_touch(k);
+        }
+
+        // Solve loop
+        auto ds = self().dsteepness();
+        while (ds > ds_epsilon) {
+            // Shorten the step if it would pass a checkpoint
+            auto next_checkpoint = checkpoint_interval > 0 ? (std::floor(t / checkpoint_interval + 1e-9) + 1) *
+                                                             checkpoint_interval
+                                                           : std::numeric_limits<value_type>::infinity();
+            auto checkpoint_due = t + dt >= next_checkpoint;
+            auto step_dt = checkpoint_due ? next_checkpoint - t : dt;
+
+            // Step, retaking the step with a smaller dt if it was too inaccurate
+            swap_rk_start();
+            auto error = rk_step(step_dt, tolerance);
+            auto growth = error > 0 ? std::clamp(0.9 * std::pow(error, -0.2), 0.2, 5.0) : 5.0;
+            if (!(error <= 1)) {
+                swap_rk_start();
+                rk_rejected++;
+                dt = step_dt * (std::isfinite(growth) ? std::min(growth, 0.9) : 0.2);
+                continue;
+            }
+            rk_accepted++;
+            if (!checkpoint_due) dt = step_dt * growth;
+
+            // Stop exactly where ds reaches epsilon, or checkpoint if requested
+            auto ds_start = ds;
+            ds = self().dsteepness();
+            if (!(ds > ds_epsilon)) {
+                ds = locate_ds_epsilon(step_dt, tolerance, ds_start, ds);
+            } else if (checkpoint_due) {
+                t = next_checkpoint;
+                self().start_checkpoint(checkpoint_name(t));
+            }
+        }
+        self().finish_checkpoint();
+        MR_PROFILE_STEPS(rk_accepted);
+
+        // Free the stages and return total simulation time
+        rk_start_h = array_type();
+        for (auto &k: rk_k) k = array_type();
+        return t;
+    }
+
+
+
+public:
+    // Step until dsteepness() falls below 0, checkpointing along the way, with steps of dt or adaptively starting
+    // with a step of dt depending on SOLVER_INTEGRATOR
     value_type solve(value_type dt=default_dt) {
-        // Read checkpoint interval from environment
+        auto INTEGRATOR = std::getenv("SOLVER_INTEGRATOR");
+        auto integrator = std::string(INTEGRATOR == nullptr ? "euler" : INTEGRATOR);
+        if (integrator == "adaptive") return solve_adaptive(dt);
+        if (integrator != "euler") {
+            throw std::logic_error("SOLVER_INTEGRATOR must be euler or adaptive, not " + integrator);
+        }
+        return solve_euler(dt);
+    }
+
+
+
+    // Step by dt until dsteepness() falls below 0, checkpointing along the way
+    value_type solve_euler(value_type dt=default_dt) {
+        // Read checkpoint interval, steps per sweep, and steps between checks of ds from environment
         value_type checkpoint_interval = 0;
         auto INTVL = std::getenv("INTVL");
         if (INTVL != nullptr) std::from_chars(INTVL, INTVL+std::strlen(INTVL), checkpoint_interval);
+        size_type steps_per_sweep = 1;
+        auto STEPS = std::getenv("SOLVER_STEPS_PER_SWEEP");
+        if (STEPS != nullptr) std::from_chars(STEPS, STEPS+std::strlen(STEPS), steps_per_sweep);
+        size_type max_ds_interval = 1;
+        auto DS_INTERVAL = std::getenv("SOLVER_DS_INTERVAL");
+        if (DS_INTERVAL != nullptr) std::from_chars(DS_INTERVAL, DS_INTERVAL+std::strlen(DS_INTERVAL), max_ds_interval);
+        steps_per_sweep = std::max(steps_per_sweep, size_type{1});
+        auto checkpoint_due = [&](auto t){ return checkpoint_interval > 0 && fmod(t+dt/5, checkpoint_interval) < 2*dt/5; };
+
+        // Up to max_steps steps, fewer if that would step past a checkpoint
+        auto steps_until_checkpoint = [&](size_type max_steps){
+            size_type nsteps = 1;
+            for (auto t_next=t+dt; nsteps<max_steps && !checkpoint_due(t_next); t_next+=dt) nsteps++;
+            return nsteps;
+        };
 
         // Solve loop
-        while (dsteepness() > std::numeric_limits<value_type>::epsilon()) {
-            step(dt);
+        [[maybe_unused]] auto start_t = t;
+        auto ds = self().dsteepness();
+        size_type ds_interval = 1;
+        while (ds > ds_epsilon) {
+            if (max_ds_interval <= 1) {
+                ds = self().multi_step_dsteepness(dt, steps_until_checkpoint(steps_per_sweep));
+            } else {
+                // Check ds after about half the steps it would take to reach epsilon if it kept falling at the rate it
+                // fell since the last check, taking at most twice as many steps as last time
+                auto last_ds = ds;
+                auto nsteps = steps_until_checkpoint(ds_interval);
+                ds = sparse_multi_step_dsteepness(dt, nsteps, steps_per_sweep);
+                auto fall_per_step = (last_ds - ds) / nsteps;
+                auto longest = value_type(std::min(2*nsteps, max_ds_interval));
+                ds_interval = fall_per_step > 0 ? std::clamp(ds / fall_per_step / 2, value_type{1}, longest) : longest;
+            }
 
             // Checkpoint if requested
-            if (checkpoint_interval > 0 && fmod(t+dt/5, checkpoint_interval) < 2*dt/5) {
-                auto check_file_name = std::format("chk-{:07.2f}.wo", t).c_str();
-                write(check_file_name);
-            }
+            if (checkpoint_due(t)) self().start_checkpoint(checkpoint_name(t));
         }
+        self().finish_checkpoint();
+        MR_PROFILE_STEPS(std::llround((t - start_t) / dt));
 
         // Return total simulation time
         return t;
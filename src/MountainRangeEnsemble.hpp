@@ -0,0 +1,216 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include "MountainRange.hpp"
+
+
+
+/* MountainRangeEnsemble solves many mountain ranges of the same size in lockstep. A single small range can't keep SIMD
+ * lanes busy for long, so the ranges are interleaved cell-major with the range innermost; with 3 ranges A, B, and C:
+ *
+ * A0 B0 C0 A1 B1 C1 A2 B2 C2 ...
+ *
+ * Rows of cells are then updated in vectorized sweeps, with the same math as MountainRange (a cell's neighbors are
+ * one row apart), a tile of rows at a time like MountainRange::fused_sweep so that narrow rows don't mean short loops.
+ * Each range stops once its own steepness derivative falls to epsilon, just as if it had been solved alone; finished
+ * ranges are copied out and the rest are compacted into narrower rows, so that ranges that are done stop costing work.
+ */
+class MountainRangeEnsemble {
+public:
+    using size_type  = MountainRange<>::size_type;
+    using value_type = MountainRange<>::value_type;
+    using array_type = MountainRange<>::array_type;
+
+
+
+private:
+    // Parameters and members
+    static constexpr const value_type default_dt = 0.01;
+    static constexpr const size_type tile_size = 1 << 10; // cells per tile in step_dsteepness
+    const size_type cells;
+    size_type lanes;                     // number of ranges still being solved, which is the length of a row
+    std::vector<size_type> lane_range;   // which range each lane holds
+    array_type r, h, g;                  // interleaved ranges still being solved
+    std::vector<value_type> lane_ds;     // steepness derivative of each lane
+    std::vector<value_type> ds_terms;    // sums of ds terms, a tile long, which are summed by lane into lane_ds
+    std::vector<value_type> t;           // simulation time of each range
+    std::vector<array_type> final_r, final_h; // each range, once it's finished
+
+
+
+    // Index of a cell of the interleaved arrays
+    size_type at(size_type cell, size_type lane) const {
+        return cell * lanes + lane;
+    }
+
+
+
+    // Update g on rows [first, last), ignoring the first and last row, and enforce the boundary condition as soon as
+    // the rows it copies are updated
+    void update_g_rows(size_type first, size_type last) {
+        auto lo = std::max(first, size_type{1}), hi = std::min(last, cells-1);
+        if (lo >= hi) return;
+        mr::kernels::active<>.update_g_strided(r.data(), h.data(), g.data(), at(lo, 0), at(hi, 0), lanes);
+        if (lo == 1)       std::copy_n(g.begin()+at(1, 0), lanes, g.begin());
+        if (hi == cells-1) std::copy_n(g.begin()+at(cells-2, 0), lanes, g.begin()+at(cells-1, 0));
+    }
+
+    // Number of rows in a tile
+    size_type tile_rows() const {
+        return std::clamp(tile_size / lanes, size_type{1}, cells);
+    }
+
+    // Add the ds terms of rows [first, last), which must be no more than a tile, to ds_terms
+    void add_ds_rows(size_type first, size_type last) {
+        if (first >= last) return;
+        mr::kernels::active<>.ds_add_strided(h.data(), g.data(), ds_terms.data(), at(first, 0), at(last, 0), lanes);
+    }
+
+    // Sum ds terms by lane into each lane's steepness derivative
+    void finish_ds() {
+        std::ranges::fill(lane_ds, 0);
+        for (size_type i=0; i<ds_terms.size(); i+=lanes) {
+            for (size_type lane=0; lane<lanes; lane++) lane_ds[lane] += ds_terms[i+lane];
+        }
+        for (auto &ds: lane_ds) ds = ds / 2 / (cells - 2);
+    }
+
+
+
+    // Step every lane and calculate each lane's new steepness derivative in one pass through memory: as soon as a tile
+    // of h is updated, the rows of g whose right neighbor is updated can be, and then the rows of ds likewise
+    void step_dsteepness(value_type dt) {
+        MR_PROFILE_SCOPE(fused_sweep, 5.0 * sizeof(value_type) * cells * lanes);
+        MR_PROFILE_STEPS(lanes);
+        ds_terms.assign(tile_rows() * lanes, 0);
+        for (size_type first=0; first<cells; first+=tile_rows()) {
+            auto last = std::min(first+tile_rows(), cells);
+            mr::kernels::active<>.update_h(h.data(), h.data(), g.data(), at(first, 0), at(last, 0), dt);
+            update_g_rows(std::max(first, size_type{1})-1, last-1);
+            add_ds_rows(std::max(first, size_type{3})-2, std::max(last, size_type{2})-2);
+        }
+        add_ds_rows(cells-2, cells-1);
+        finish_ds();
+        for (auto range: lane_range) t[range] += dt;
+    }
+
+
+
+    // Copy finished lanes out and squeeze the rest together
+    void retire_finished_lanes() {
+        auto finished = [this](size_type lane){
+            return !(lane_ds[lane] > std::numeric_limits<value_type>::epsilon());
+        }; // https://tinyurl.com/byusc-lambda
+        std::vector<size_type> kept;
+        for (size_type lane=0; lane<lanes; lane++) {
+            if (!finished(lane)) {
+                kept.push_back(lane);
+                continue;
+            }
+            auto range = lane_range[lane];
+            final_r[range].resize(cells);
+            final_h[range].resize(cells);
+            for (size_type i=0; i<cells; i++) {
+                final_r[range][i] = r[at(i, lane)];
+                final_h[range][i] = h[at(i, lane)];
+            }
+        }
+        if (kept.size() == lanes) return;
+
+        // Compact
+        auto compact = [&](const array_type &x){
+            array_type narrow(cells * kept.size());
+            for (size_type i=0; i<cells; i++) {
+                for (size_type k=0; k<kept.size(); k++) narrow[i*kept.size()+k] = x[at(i, kept[k])];
+            }
+            return narrow;
+        }; // https://tinyurl.com/byusc-lambda
+        r = compact(r);
+        h = compact(h);
+        g = compact(g);
+        std::vector<size_type> kept_range;
+        for (auto lane: kept) kept_range.push_back(lane_range[lane]);
+        lane_range = std::move(kept_range);
+        lanes = kept.size();
+        lane_ds.resize(lanes);
+    }
+
+
+
+public:
+    // Read every mountain range in filenames, which must all be the same size
+    MountainRangeEnsemble(const std::vector<std::string> &filenames): cells{[&]{ // https://tinyurl.com/byusc-lambdai
+                if (filenames.empty()) throw std::logic_error("An ensemble needs at least one mountain range");
+                auto m = MountainRange<>(filenames[0].c_str());
+                if (m.dimensions().size() != 1) {
+                    throw std::logic_error("Only one-dimensional mountain ranges can be solved as an ensemble");
+                }
+                return m.size();
+            }()}, lanes{filenames.size()}, lane_range(lanes), r(cells*lanes), h(cells*lanes), g(cells*lanes),
+            lane_ds(lanes), t(lanes), final_r(lanes), final_h(lanes) {
+        if (cells < 3) throw std::logic_error("Mountain ranges in an ensemble must have at least 3 cells");
+        if (auto integrator = std::getenv("SOLVER_INTEGRATOR"); integrator && std::string(integrator) != "euler") {
+            throw std::logic_error("Mountain ranges in an ensemble can only be solved with fixed steps");
+        }
+        for (size_type lane=0; lane<lanes; lane++) {
+            auto m = MountainRange<>(filenames[lane].c_str());
+            if (m.dimensions().size() != 1 || m.size() != cells) {
+                throw std::logic_error("Mountain ranges in an ensemble must all be one-dimensional and the same size");
+            }
+            lane_range[lane] = lane;
+            t[lane] = m.sim_time();
+            for (size_type i=0; i<cells; i++) {
+                r[at(i, lane)] = m.uplift_rate()[i];
+                h[at(i, lane)] = m.height()[i];
+            }
+        }
+
+        // Initialize g and ds
+        update_g_rows(0, cells);
+        ds_terms.assign(tile_rows() * lanes, 0);
+        for (size_type first=1; first<cells-1; first+=tile_rows()) {
+            add_ds_rows(first, std::min(first+tile_rows(), cells-1));
+        }
+        finish_ds();
+    }
+
+
+
+    // Accessors
+    auto size()                        const { return cells; }
+    auto count()                       const { return t.size(); }
+    auto sim_time(size_type range)     const { return t[range]; }
+    auto &uplift_rate(size_type range) const { return final_r[range]; } // empty until range is solved
+    auto &height(size_type range)      const { return final_h[range]; } // empty until range is solved
+
+
+
+    // Step every range until its steepness derivative falls to epsilon, returning the latest simulation time
+    value_type solve(value_type dt=default_dt) {
+        retire_finished_lanes();
+        while (lanes > 0) {
+            step_dsteepness(dt);
+            retire_finished_lanes();
+        }
+        return std::ranges::max(t);
+    }
+
+
+
+    // Write a solved range to a file in the same format as MountainRange, handling write errors gracefully
+    void write(size_type range, const char *filename) const {
+        auto f = std::ofstream(filename);
+        try {
+            size_type ndims = 1;
+            try_write_bytes(f, &ndims, &cells, &t[range]);
+            try_write_bytes(f, final_r[range].data(), final_r[range].size());
+            try_write_bytes(f, final_h[range].data(), final_h[range].size());
+        } catch (const std::ios_base::failure &e) {
+            throw std::logic_error("Failed to write to " + std::string(filename));
+        }
+    }
+};
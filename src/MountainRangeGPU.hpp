@@ -9,7 +9,7 @@
 
 
 // Helper function to get iterators to first and last indices of an array
-// Use NVidia-specific code if it's available, otherwise use std::ranges
+// Use NVidia-specific code if it's available, otherwise a counting iterator of our own
 #if __has_include(<thrust/iterator/counting_iterator.h>)
 #include <thrust/iterator/counting_iterator.h>
 namespace {
@@ -18,26 +18,56 @@ namespace {
     }
 };
 #else
-#include <ranges>
+#include <iterator>
+#include <compare>
 namespace {
+    // Iterator over indices; std::views::iota's iterators don't report random access through std::iterator_traits,
+    // which the parallel algorithms of GCC and Clang check for before splitting work, so they'd run serially
+    struct index_iterator {
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = size_t;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const size_t *;
+        using reference         = size_t;
+
+        size_t i = 0;
+
+        size_t operator*() const { return i; }
+        size_t operator[](difference_type n) const { return i + n; }
+        index_iterator &operator++() { ++i; return *this; }
+        index_iterator &operator--() { --i; return *this; }
+        index_iterator operator++(int) { return {i++}; }
+        index_iterator operator--(int) { return {i--}; }
+        index_iterator &operator+=(difference_type n) { i += n; return *this; }
+        index_iterator &operator-=(difference_type n) { i -= n; return *this; }
+        friend index_iterator operator+(index_iterator it, difference_type n) { return {it.i + n}; }
+        friend index_iterator operator+(difference_type n, index_iterator it) { return {it.i + n}; }
+        friend index_iterator operator-(index_iterator it, difference_type n) { return {it.i - n}; }
+        friend difference_type operator-(index_iterator a, index_iterator b) { return difference_type(a.i - b.i); }
+        friend auto operator<=>(index_iterator a, index_iterator b) = default;
+    };
+
     auto index_range(const auto &x) {
-        auto interior = std::ranges::views::iota(0ul, x.size());
-        return std::make_tuple(interior.begin(), interior.end());
+        return std::make_tuple(index_iterator{0}, index_iterator{x.size()});
     }
 };
 #endif
 
 
 
-class MountainRangeGPU: public MountainRange {
+class MountainRangeGPU final: public MountainRange<double, MountainRangeGPU> {
+    friend MountainRange; // which calls this class's versions of the functions solving is built from
+
 public:
     // Delegate construction to MountainRange
     using MountainRange::MountainRange;
 
 
 
-    // Steepness derivative
-    value_type dsteepness() override {
+    // Steepness derivative; multi-dimensional ranges are left to the CPU's tiled sweeps
+    value_type dsteepness() {
+        if (ndims > 1) return MountainRange::dsteepness();
+
         // Get iterators to first and last cells to be reduced
         auto [first, last] = index_range(h); // https://tinyurl.com/byusc-structbind
 
@@ -52,7 +82,9 @@ public:
 
 
     // Iterate from t to t+dt in one step
-    value_type step(value_type dt) override {
+    value_type step(value_type dt) {
+        if (ndims > 1) return MountainRange::step(dt);
+
         // Get iterators to first and last cells to be updated
         auto [first, last] = index_range(h); // https://tinyurl.com/byusc-structbind
 
@@ -62,18 +94,54 @@ public:
                           h[i] += dt * g[i];
                       }); // https://tinyurl.com/byusc-lambda
 
-        // Update g
-        std::for_each(std::execution::par_unseq, first, last,
-                      [n=cells, r=r.data(), h=h.data(), g=g.data()](auto i){
-                          auto &gcell = g[i];
-                          if (i==0)   i+=1;
-                          if (i==n-1) i-=1;
+        // Update g in the interior, where no cell needs special treatment so that the loop vectorizes
+        std::for_each(std::execution::par_unseq, first+1, last-1,
+                      [r=r.data(), h=h.data(), g=g.data()](auto i){
                           auto L = (h[i-1] + h[i+1]) / 2 - h[i];
-                          gcell = r[i] - pow(h[i], 3) + L;
+                          g[i] = r[i] - h[i]*h[i]*h[i] + L;
                       }); // https://tinyurl.com/byusc-lambda
 
+        // Enforce boundary condition, copying with parallel algorithms so that g never leaves the device
+        std::copy(std::execution::par_unseq, g.begin()+1, g.begin()+2, g.begin());
+        std::copy(std::execution::par_unseq, g.end()-2, g.end()-1, g.end()-1);
+
         // Update and return simulation time
         t += dt;
         return t;
     }
+
+
+
+    // Parallel algorithms can't express the fused sweep's dependencies, so just step then calculate dsteepness
+    value_type step_dsteepness(value_type dt) {
+        step(dt);
+        return dsteepness();
+    }
+
+
+
+    // Temporal blocking relies on per-tile scratch space in cache, so just take the steps one at a time
+    value_type multi_step_dsteepness(value_type dt, size_type nsteps) {
+        auto ds = step_dsteepness(dt);
+        for (size_type s=1; s<nsteps && ds > ds_epsilon; s++) ds = step_dsteepness(dt);
+        return ds;
+    }
+
+
+
+    // Without a sweep to fold it into, skipping dsteepness saves a whole pass through memory per step
+    void multi_step(value_type dt, size_type nsteps) {
+        for (size_type s=0; s<nsteps; s++) step(dt);
+    }
+
+
+
+protected:
+    // Copy on the device rather than dragging the state back to the host
+    void copy_state(const array_type &from_h, const array_type &from_g, array_type &to_h, array_type &to_g) {
+        to_h.resize(from_h.size());
+        to_g.resize(from_g.size());
+        std::copy(std::execution::par_unseq, from_h.begin(), from_h.end(), to_h.begin());
+        std::copy(std::execution::par_unseq, from_g.begin(), from_g.end(), to_g.begin());
+    }
 };
\ No newline at end of file
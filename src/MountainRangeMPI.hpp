@@ -1,4 +1,6 @@
 #pragma once
+#include <span>
+#include <optional>
 #include <mpl/mpl.hpp>
 #include "MountainRange.hpp"
 
@@ -30,14 +32,37 @@ namespace {
  * iteration to keep the grid consistent between processes--for example, at the end of an iteration, process A will
  * receive the value in process B's cell 4 and store it in its own cell 4.
  *
+ * Halos can be made deeper by setting the environment variable SOLVER_HALO_WIDTH. With halos w cells wide, each
+ * process also updates its halos, which stay valid for w steps (each step spoils one more cell from the outside in), so
+ * halos only need to be exchanged and ds only needs to be summed across processes every w steps.
+ *
+ * Multi-dimensional ranges are split into blocks over a Cartesian grid of processes, as square as MPI can make it. Each
+ * process stores its block plus a layer of halo cells on each face it shares with another process, and every step
+ * swaps the faces of g with the neighbors along every axis. Corners and edges of the halos are never needed, since
+ * neither the Laplacian nor the gradient looks diagonally. Halos are always one cell deep in this case.
+ *
  * The MPI within the class is completely self-contained--users don't need to explicitly make any MPI calls.
  */
-class MountainRangeMPI: public MountainRange {
+class MountainRangeMPI final: public MountainRange<double, MountainRangeMPI> {
+    friend MountainRange; // which calls this class's versions of the functions solving is built from
+
     // MPI-related members (initialized at the bottom of this file)
     static mpl::communicator comm_world;
     static const int comm_rank;
     static const int comm_size;
 
+    // Number of halo cells stored on each side of the border between processes
+    const size_type halo_width;
+
+    // The checkpoint being written, if any, and its pending writes
+    std::optional<mpl::file> checkpoint_file;
+    mpl::irequest_pool checkpoint_requests;
+
+    // For multi-dimensional ranges, the cells along each axis this process is in charge of and stores (including
+    // halos), and the ranks of the processes below and above it along each axis (-1 if there's no such process)
+    std::vector<std::array<size_type, 2>> owned_box, stored_box;
+    std::vector<std::array<int, 2>> neighbors;
+
 
 
     // Determine which cells this process is in charge of updating
@@ -45,31 +70,149 @@ class MountainRangeMPI: public MountainRange {
         return mr::split_range(cells, comm_rank, comm_size);
     }
 
+    // Determine which cells this process stores, including halos
+    auto this_process_stored_range() const {
+        auto [first, last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
+        return std::array{first - std::min(first, halo_width), std::min(last + halo_width, cells)};
+    }
+
+    // Determine the local indices of the cells this process adds to ds (those it's in charge of, but never the first or
+    // last cell of the mountain range)
+    auto local_ds_range() const {
+        auto [first, last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
+        auto stored_first = this_process_stored_range()[0];
+        return std::array{std::max(first, size_type{1}) - stored_first, std::min(last, cells-1) - stored_first};
+    }
 
 
-    // Read a MountainRange from an mpl::file
-    MountainRangeMPI(mpl::file &&f): MountainRange(read_at_all<decltype(ndims)>(f, 0),
-                                                   read_at_all<decltype(cells)>(f, sizeof(ndims)),
-                                                   read_at_all<decltype(t)>(    f, sizeof(ndims)+sizeof(cells)),
-                                                   3, 3) { // initialize r and h to minimum size; they're resized below
-        // Figure out which cells this process is in charge of
-        auto [first, last] = this_process_cell_range();
-        if (first > 0)     first -= 1; // include left halo
-        if (last  < cells) last  += 1; // include right halo
-
-        // Resize the vectors
-        r.resize(last-first);
-        h.resize(last-first);
-        g.resize(last-first);
-
-        // Figure out read offsets
-        auto r_offset = header_size + sizeof(value_type) * first;
-        auto h_offset = r_offset + sizeof(value_type) * cells;
 
-        // Read
-        auto layout = mpl::vector_layout<value_type>(r.size());
-        f.read_at(r_offset, r.data(), layout);
-        f.read_at(h_offset, h.data(), layout);
+    // Read the dimensions of the range in an mpl::file, checking their count first
+    static std::vector<size_type> read_dimensions_at_all(mpl::file &f) {
+        auto file_ndims = read_at_all<size_type>(f, 0);
+        if (file_ndims < 1 || file_ndims > max_ndims) handle_wrong_dimensions();
+        std::vector<size_type> file_dims(file_ndims);
+        for (size_type a=0; a<file_ndims; a++) file_dims[a] = read_at_all<size_type>(f, sizeof(size_type) * (1+a));
+        return file_dims;
+    }
+
+
+
+    // Split a multi-dimensional range over a Cartesian grid of processes, filling in owned_box, stored_box, and
+    // neighbors, and lay out the cells this process stores. Processes at the end of an axis with more processes than
+    // cells get no cells at all, and take no part in halo exchanges.
+    void split_grid() {
+        mpl::cartesian_communicator::dimensions process_dims;
+        for (size_type a=0; a<ndims; a++) process_dims.add(0, mpl::cartesian_communicator::periodicity::nonperiodic);
+        process_dims = mpl::dims_create(comm_size, process_dims);
+        auto comm_grid = mpl::cartesian_communicator(comm_world, process_dims, false); // keep comm_world's ranks
+        auto coordinates = comm_grid.coordinates();
+
+        // Find this process's block
+        owned_box.resize(ndims);
+        for (size_type a=0; a<ndims; a++) owned_box[a] = mr::split_range(dims[a], coordinates[a], process_dims.size(a));
+        auto has_cells = std::ranges::all_of(owned_box, [](auto &box){ return box[0] < box[1]; });
+
+        // Add halos on faces shared with other processes, and find those processes
+        stored_box = owned_box;
+        neighbors.assign(ndims, {-1, -1});
+        std::vector<size_type> stored_dims(ndims, 0);
+        for (size_type a=0; a<ndims && has_cells; a++) {
+            auto shifted = comm_grid.shift(a, 1);
+            auto [first, last] = owned_box[a]; // https://tinyurl.com/byusc-structbind
+            if (first > 0) {
+                stored_box[a][0] -= 1;
+                neighbors[a][0] = shifted.source;
+            }
+            if (last < dims[a]) {
+                stored_box[a][1] += 1;
+                neighbors[a][1] = shifted.destination;
+            }
+            stored_dims[a] = stored_box[a][1] - stored_box[a][0];
+        }
+        set_local_dims(stored_dims);
+    }
+
+
+
+    // Call F(file_cell, local_cell, n) for each run of cells along the last axis of a block of cells ([box[a][0],
+    // box[a][1]) along each axis a) that this process stores, where n is the run's length, file_cell is the index of
+    // its first cell in the whole range, and local_cell is that cell's index here
+    void for_each_box_row(const std::vector<std::array<size_type, 2>> &box, auto F) const {
+        if (std::ranges::any_of(box, [](auto &b){ return b[0] >= b[1]; })) return;
+        std::vector<size_type> index(ndims);
+        for (size_type a=0; a<ndims; a++) index[a] = box[a][0];
+        while (true) {
+            size_type file_cell = 0, local_cell = 0;
+            for (size_type a=0; a<ndims; a++) {
+                file_cell = file_cell * dims[a] + index[a];
+                local_cell += (index[a] - stored_box[a][0]) * local_strides[a];
+            }
+            F(file_cell, local_cell, box[ndims-1][1] - box[ndims-1][0]);
+            auto a = ndims-1;
+            while (a > 0 && ++index[a-1] == box[a-1][1]) {
+                index[a-1] = box[a-1][0];
+                a--;
+            }
+            if (a == 0) break;
+        }
+    }
+
+
+
+    // Read a MountainRange from an mpl::file
+    MountainRangeMPI(mpl::file &&f): MountainRangeMPI(std::move(f), read_dimensions_at_all(f)) {}
+
+    MountainRangeMPI(mpl::file &&f, std::vector<size_type> file_dims):
+            MountainRange(file_dims, read_at_all<value_type>(f, header_size(file_dims.size()) - sizeof(value_type))),
+            halo_width{[this]{ // https://tinyurl.com/byusc-lambdai
+                if (ndims > 1) return size_type{1};
+                size_type width = 1;
+                auto width_str = std::getenv("SOLVER_HALO_WIDTH");
+                if (width_str != nullptr) std::from_chars(width_str, width_str+std::strlen(width_str), width);
+                // Halos can't reach past the cells of the neighboring process
+                return std::clamp(width, size_type{1}, std::max(cells/comm_size, size_type{1}));
+            }()} {
+#ifdef _OPENMP
+        // OpenMP threads never make MPI calls, but MPI still has to support threads (MPI_THREAD_FUNNELED)
+        if (mpl::environment::threading_mode() == mpl::threading_modes::single) {
+            throw std::logic_error("This MPI implementation doesn't support threads");
+        }
+#endif
+
+        // Read the block of a multi-dimensional range this process stores a row at a time
+        auto r_offset = header_size(ndims), h_offset = r_offset + sizeof(value_type) * cells;
+        if (ndims > 1) {
+            split_grid();
+            size_type stored_cells = 1;
+            for (auto d: local_dims) stored_cells *= d;
+            r_storage.resize(stored_cells);
+            h.resize(stored_cells);
+            g.assign(stored_cells, 0);
+            for_each_box_row(stored_box, [&](auto file_cell, auto local_cell, auto n){
+                auto layout = mpl::vector_layout<value_type>(n);
+                f.read_at(r_offset + sizeof(value_type) * file_cell, r_storage.data()+local_cell, layout);
+                f.read_at(h_offset + sizeof(value_type) * file_cell, h.data()+local_cell, layout);
+            }); // https://tinyurl.com/byusc-lambda
+        } else {
+            // Figure out which cells this process stores, including halos
+            auto [first, last] = this_process_stored_range(); // https://tinyurl.com/byusc-structbind
+
+            // Resize the vectors
+            r_storage.resize(last-first);
+            h.resize(last-first);
+            g.assign(last-first, 0);
+
+            // Read
+            auto layout = mpl::vector_layout<value_type>(r_storage.size());
+            f.read_at(r_offset + sizeof(value_type) * first, r_storage.data(), layout);
+            f.read_at(h_offset + sizeof(value_type) * first, h.data(), layout);
+        }
+        r = r_storage;
+#ifdef _OPENMP
+        first_touch_r();
+        first_touch(h);
+        first_touch(g);
+#endif
 
         // Update g
         step(0);
@@ -78,6 +221,14 @@ class MountainRangeMPI: public MountainRange {
 
 
 public:
+    // Help message for the environment variables that affect this class
+    inline static const std::string help_message = MountainRange::help_message + "\n" +
+            "With MPI, each step in a multi-step sweep overlaps its ds reduction with the next step.\n"
+            "Set the environment variable SOLVER_HALO_WIDTH to a positive integer to exchange halos that many cells "
+            "deep and only that often in a sweep (default 1; one-dimensional ranges only).";
+
+
+
     // Read a MountainRange from a file with MPI I/O, handling errors gracefully
     MountainRangeMPI(const char *filename) try: MountainRangeMPI(mpl::file(comm_world, filename,
                                                                  mpl::file::access_mode::read_only)) {
@@ -88,21 +239,35 @@ public:
 
 
     // Write a MountainRange to a file with MPI I/O, handling errors gracefully
-    void write(const char *filename) const override try {
+    void write(const char *filename) const try {
+        MR_PROFILE_SCOPE(write, 2.0 * sizeof(value_type) * (this_process_cell_range()[1] -
+                                                             this_process_cell_range()[0]));
+
         // Open file write-only
         auto f = mpl::file(comm_world, filename, mpl::file::access_mode::create|mpl::file::access_mode::write_only);
 
         // Write header
         f.write_all(ndims);
-        f.write_all(cells);
+        for (auto d: dims) f.write_all(d);
         f.write_all(t);
 
+        // Write the block of a multi-dimensional range this process is in charge of a row at a time
+        if (ndims > 1) {
+            for_each_box_row(owned_box, [&](auto file_cell, auto local_cell, auto n){
+                auto layout = mpl::vector_layout<value_type>(n);
+                auto r_offset = header_size(ndims) + sizeof(value_type) * file_cell;
+                f.write_at(r_offset, r.data()+local_cell, layout);
+                f.write_at(r_offset + sizeof(value_type) * cells, h.data()+local_cell, layout);
+            }); // https://tinyurl.com/byusc-lambda
+            return;
+        }
+
         // Figure out which part of r and h this process is in charge of writing
         auto [first, last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
         auto layout = mpl::vector_layout<value_type>(last-first);
-        auto r_offset = header_size + sizeof(value_type) * first;
+        auto r_offset = header_size(ndims) + sizeof(value_type) * first;
         auto h_offset = r_offset + sizeof(value_type) * cells;
-        auto halo_offset = comm_rank == 0 ? 0 : 1;
+        auto halo_offset = first - this_process_stored_range()[0];
 
         // Write body
         f.write_at(r_offset, r.data()+halo_offset, layout);
@@ -115,15 +280,94 @@ public:
  
 
 
+protected:
+    // Start writing a checkpoint with non-blocking MPI I/O so that stepping can continue while it's written. This
+    // process's part of h is copied first; if the last checkpoint is still being written, wait for it before
+    // overwriting its copy.
+    void start_checkpoint(const std::string &filename) try {
+        finish_checkpoint();
+        MR_PROFILE_SCOPE(checkpoint);
+        checkpoint_t = t;
+        checkpoint_h.assign(h.begin(), h.end());
+
+        // Open file write-only
+        auto &f = checkpoint_file.emplace(comm_world, filename.c_str(),
+                                          mpl::file::access_mode::create|mpl::file::access_mode::write_only);
+
+        // Start writing the header from the first process
+        if (comm_rank == 0) {
+            checkpoint_requests.push(f.iwrite_at(0, ndims));
+            for (size_type a=0; a<ndims; a++) checkpoint_requests.push(f.iwrite_at(sizeof(ndims) * (1+a), dims[a]));
+            checkpoint_requests.push(f.iwrite_at(header_size(ndims) - sizeof(value_type), checkpoint_t));
+        }
+
+        // Start writing the body, exactly as in write
+        if (ndims > 1) {
+            for_each_box_row(owned_box, [&](auto file_cell, auto local_cell, auto n){
+                auto layout = mpl::vector_layout<value_type>(n);
+                auto r_offset = header_size(ndims) + sizeof(value_type) * file_cell;
+                checkpoint_requests.push(f.iwrite_at(r_offset, r.data()+local_cell, layout));
+                checkpoint_requests.push(f.iwrite_at(r_offset + sizeof(value_type) * cells,
+                                                     checkpoint_h.data()+local_cell, layout));
+            }); // https://tinyurl.com/byusc-lambda
+            return;
+        }
+        auto [first, last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
+        auto layout = mpl::vector_layout<value_type>(last-first);
+        auto r_offset = header_size(ndims) + sizeof(value_type) * first;
+        auto h_offset = r_offset + sizeof(value_type) * cells;
+        auto halo_offset = first - this_process_stored_range()[0];
+        checkpoint_requests.push(f.iwrite_at(r_offset, r.data()+halo_offset, layout));
+        checkpoint_requests.push(f.iwrite_at(h_offset, checkpoint_h.data()+halo_offset, layout));
+
+        // Handle errors
+    } catch (const mpl::io_failure &e) {
+        handle_write_failure(filename.c_str());
+    }
+
+
+
+    // Wait for the checkpoint in flight, if any, to be written, then close its file
+    void finish_checkpoint() {
+        if (!checkpoint_file) return; // not profiled, so runs without checkpoints show no checkpoint phase
+        MR_PROFILE_SCOPE(checkpoint);
+        checkpoint_requests.waitall();
+        checkpoint_file.reset();
+    }
+
+
+
+    // The largest of x over every process, for the adaptive integrator's error estimate
+    value_type global_max(value_type x) {
+        MR_PROFILE_SCOPE(allreduce);
+        comm_world.allreduce(mpl::max<value_type>(), x);
+        return x;
+    }
+
+
+
+public:
     // Steepness derivative
-    value_type dsteepness() override {
+    value_type dsteepness() {
         // Local and global dsteepness holders
+        auto [ds_first, ds_last] = local_ds_range(); // https://tinyurl.com/byusc-structbind
         value_type global_ds, local_ds = 0;
 
-        // Iterate over this process's cells
-        for (size_t i=1; i<r.size()-1; i++) local_ds += ds_cell(i);
+        // Iterate over this process's cells; the interior of a multi-dimensional range's stored block is exactly the
+        // cells this process adds to ds
+        if (ndims > 1) {
+            local_ds = MountainRange::dsteepness();
+        } else {
+            #pragma omp parallel for reduction(+:local_ds)
+            for (size_type b=0; b<block_count(); b++) {
+                auto [first, last] = block_range(b);
+                MR_PROFILE_SCOPE(dsteepness, 2.0 * sizeof(value_type) * (last - first));
+                local_ds += ds_cells(std::max(first, ds_first), std::min(last, ds_last));
+            }
+        }
 
         // Sum the ds from all processes and return it
+        MR_PROFILE_SCOPE(allreduce);
         comm_world.allreduce(std::plus<>(), local_ds, global_ds);
         return global_ds;
     }
@@ -131,13 +375,78 @@ public:
 
 
 private:
-    // Swap halo cells between processes to keep simulation consistent between processes
-    void exchange_halos(auto &x) {
-        // Halos and first/last active cells
-        auto       &first_halo      = x[0];
-        auto       &last_halo       = x[x.size()-1];
-        const auto &first_real_cell = x[1];
-        const auto &last_real_cell  = x[x.size()-2];
+    // Call F(i, n) for each run of n cells starting at i in the layer of a multi-dimensional range's stored block at
+    // index layer along axis a, leaving out the edges of the layer along the other axes; the stencil never reads those
+    // cells, and since every face is exchanged at once they would otherwise hold a neighbor's stale halo
+    void for_each_face_run(size_type a, size_type layer, auto F) const {
+        for (size_type b=0; b<ndims; b++) if (b != a && local_dims[b] < 3) return;
+        auto run_axis = ndims - 1;
+        auto n = a == run_axis ? size_type{1} : local_dims[run_axis] - 2;
+        std::vector<size_type> index(ndims, 1);
+        index[a] = layer;
+        while (true) {
+            size_type i = 0;
+            for (size_type b=0; b<ndims; b++) i += index[b] * local_strides[b];
+            F(i, n);
+            // Move to the next run like an odometer, over the axes other than a and the one runs lie along
+            auto b = a == run_axis ? ndims : run_axis;
+            while (b-- > 0) {
+                if (b == a) continue;
+                if (++index[b] < local_dims[b] - 1) break;
+                index[b] = 1;
+            }
+            if (b > ndims) return; // every axis wrapped around
+        }
+    }
+
+
+
+    // Swap the faces of x with the neighboring processes along every axis of a multi-dimensional range, sending every
+    // face at once
+    void exchange_faces(array_type &x) {
+        MR_PROFILE_SCOPE(halo_exchange);
+        std::vector<std::vector<value_type>> send(2*ndims), recv(2*ndims);
+        mpl::irequest_pool requests;
+        for (size_type a=0; a<ndims; a++) {
+            for (size_type side=0; side<2; side++) {
+                if (neighbors[a][side] < 0) continue;
+                auto face = 2*a + side;
+                for_each_face_run(a, side == 0 ? 1 : local_dims[a]-2, [&](auto i, auto n){
+                    send[face].insert(send[face].end(), x.begin()+i, x.begin()+i+n);
+                }); // https://tinyurl.com/byusc-lambda
+                recv[face].resize(send[face].size());
+                auto layout = mpl::vector_layout<value_type>(send[face].size());
+                // Tags indicate the axis and direction of data flow
+                requests.push(comm_world.isend(send[face].data(), layout, neighbors[a][side], mpl::tag_t(face)));
+                requests.push(comm_world.irecv(recv[face].data(), layout, neighbors[a][side],
+                                               mpl::tag_t(2*a + 1-side)));
+            }
+        }
+        requests.waitall();
+        for (size_type a=0; a<ndims; a++) {
+            for (size_type side=0; side<2; side++) {
+                if (neighbors[a][side] < 0) continue;
+                auto in = recv[2*a + side].begin();
+                for_each_face_run(a, side == 0 ? 0 : local_dims[a]-1, [&](auto i, auto n){
+                    std::copy_n(in, n, x.begin()+i);
+                    in += n;
+                });
+            }
+        }
+    }
+
+
+
+    // Swap the width halo cells of each of xs between processes to keep simulation consistent between processes. The
+    // cells of all of xs go in a single message in each direction.
+    void exchange_halos(size_type width, auto &...xs) {
+        MR_PROFILE_SCOPE(halo_exchange);
+
+        // Send and receive buffers and their layout
+        auto count = width * sizeof...(xs);
+        std::vector<value_type> send(count), recv(count);
+        auto layout = mpl::vector_layout<value_type>(count);
+        auto n = h.size();
 
         // Tags for sends and receives
         auto left_tag  = mpl::tag_t{0}, right_tag = mpl::tag_t{1}; // direction of data flow is indicated
@@ -147,13 +456,21 @@ private:
 
         // Exchange halos with the process to the left if there is such a process
         if (global_first > 0) {
-            comm_world.sendrecv(first_real_cell, comm_rank-1, left_tag,   // send
-                                first_halo,      comm_rank-1, right_tag); // receive
+            auto out = send.begin();
+            ((out = std::copy_n(xs.begin()+width, width, out)), ...);
+            comm_world.sendrecv(send.data(), layout, comm_rank-1, left_tag,   // send
+                                recv.data(), layout, comm_rank-1, right_tag); // receive
+            auto in = recv.begin();
+            ((std::copy_n(in, width, xs.begin()), in += width), ...);
         }
         // Exchange halos with the process to the right if this process has a real end halo
         if (global_last < cells) {
-            comm_world.sendrecv(last_real_cell,  comm_rank+1, right_tag,  // send
-                                last_halo,       comm_rank+1, left_tag);  // receive
+            auto out = send.begin();
+            ((out = std::copy_n(xs.begin()+(n-2*width), width, out)), ...);
+            comm_world.sendrecv(send.data(), layout, comm_rank+1, right_tag,  // send
+                                recv.data(), layout, comm_rank+1, left_tag);  // receive
+            auto in = recv.begin();
+            ((std::copy_n(in, width, xs.begin()+(n-width)), in += width), ...);
         }
     }
 
@@ -161,15 +478,30 @@ private:
 
 public:
     // Iterate from t to t+dt in one step
-    value_type step(value_type dt) override {
+    value_type step(value_type dt) {
+        if (ndims > 1) {
+            MountainRange::step(dt);
+            exchange_faces(g); // h in the halos is still valid since g in the halos was
+            return t;
+        }
         auto [global_first, global_last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
 
         // Update h
-        for (size_t i=0; i<h.size(); i++) update_h_cell(i, dt);
+        #pragma omp parallel for
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b);
+            MR_PROFILE_SCOPE(update_h, 3.0 * sizeof(value_type) * (last - first));
+            update_h_cells(first, last, dt);
+        }
 
         // Update g
-        for (size_t i=1; i<g.size()-1; i++) update_g_cell(i);
-        exchange_halos(g);
+        #pragma omp parallel for
+        for (size_type b=0; b<block_count(); b++) {
+            auto [first, last] = block_range(b);
+            MR_PROFILE_SCOPE(update_g, 3.0 * sizeof(value_type) * (last - first));
+            update_g_cells(std::max(first, size_type{1}), std::min(last, g.size()-1));
+        }
+        exchange_halos(halo_width, g); // h in the halos is still valid since g in the halos was
 
         // Enforce boundary condition
         if (global_first == 0)    g[0]          = g[1];
@@ -179,6 +511,250 @@ public:
         t += dt;
         return t;
     }
+
+
+
+    // Iterate from t to t+dt and calculate the new steepness derivative with one pass through memory
+    value_type step_dsteepness(value_type dt) {
+        if (ndims > 1) return MountainRange::step_dsteepness(dt);
+        if (halo_width > 1) return deep_multi_step_dsteepness(dt, 1);
+        auto local_ds = fused_step(dt, h, g);
+
+        // Sum the ds from all processes, increment t, and return ds
+        value_type global_ds;
+        {
+            MR_PROFILE_SCOPE(allreduce);
+            comm_world.allreduce(std::plus<>(), local_ds, global_ds);
+        }
+        t += dt;
+        return global_ds;
+    }
+
+
+
+    // Take up to nsteps steps, summing each step's ds across processes while the next step is being taken. Each step is
+    // written to h_next and g_next so that a step taken past the one that brings ds to epsilon can just be dropped.
+    value_type multi_step_dsteepness(value_type dt, size_type nsteps) {
+        if (ndims > 1) return step_dsteepness(dt);
+        if (halo_width > 1) return deep_multi_step_dsteepness(dt, nsteps);
+        if (nsteps <= 1) return step_dsteepness(dt);
+        h_next.resize(h.size());
+        g_next.resize(g.size());
+
+        // Take the first step and start summing its ds
+        value_type local_ds = fused_step(dt, h_next, g_next), global_ds;
+        auto finish_step = [&]{
+            std::swap(h, h_next);
+            std::swap(g, g_next);
+            t += dt;
+            return comm_world.iallreduce(std::plus<>(), local_ds, global_ds);
+        };
+        auto request = finish_step();
+
+        // Take each following step before checking whether the last one should have been the final one
+        for (size_type s=1; s<nsteps; s++) {
+            auto next_local_ds = fused_step(dt, h_next, g_next);
+            wait_for_allreduce(request);
+            if (!(global_ds > ds_epsilon)) return global_ds;
+            local_ds = next_local_ds;
+            request = finish_step();
+        }
+        wait_for_allreduce(request);
+        return global_ds;
+    }
+
+
+
+    // Take nsteps steps without summing ds across processes, which leaves only the halo exchanges to communicate
+    void multi_step(value_type dt, size_type nsteps) {
+        if (ndims > 1) {
+            MountainRange::multi_step(dt, nsteps);
+            return;
+        }
+        if (halo_width == 1) {
+            for (size_type s=0; s<nsteps; s++) {
+                fused_step(dt, h, g);
+                t += dt;
+            }
+            return;
+        }
+        for (size_type taken=0; taken<nsteps; taken+=halo_width) {
+            auto cycle_steps = std::min(halo_width, nsteps-taken);
+            for (size_type s=0; s<cycle_steps; s++) deep_step(dt, h.data(), g.data());
+            exchange_halos(halo_width, h, g);
+        }
+    }
+
+
+
+private:
+    // Wait for a nonblocking sum of ds across processes
+    static void wait_for_allreduce(auto &request) {
+        MR_PROFILE_SCOPE(allreduce);
+        request.wait();
+    }
+
+
+
+    // fused_sweep(0, h.size(), dt, h_out, g_out), split into blocks among OpenMP threads if there are any. Each block's
+    // sweep leaves g and ds undone around its edges, which are filled in once every block's h and g are updated.
+    value_type local_fused_sweep(value_type dt, value_type *h_out, value_type *g_out) {
+        auto n = h.size();
+        value_type ds = 0;
+        #pragma omp parallel reduction(+:ds)
+        {
+            #pragma omp for schedule(static)
+            for (size_type b=0; b<block_count(); b++) {
+                auto [first, last] = block_range(b); // https://tinyurl.com/byusc-structbind
+                MR_PROFILE_SCOPE(fused_sweep, 5.0 * sizeof(value_type) * (last - first));
+                ds += fused_sweep(first, last, dt, h_out, g_out);
+            }
+            #pragma omp for schedule(static)
+            for (size_type b=1; b<block_count(); b++) {
+                auto edge = block_range(b)[0];
+                MR_PROFILE_SCOPE(fused_sweep);
+                update_g_cells(r.data(), h_out, g_out, edge-1, std::min(edge+1, n-1));
+            }
+            #pragma omp for schedule(static)
+            for (size_type b=1; b<block_count(); b++) {
+                auto edge = block_range(b)[0];
+                MR_PROFILE_SCOPE(fused_sweep);
+                ds += ds_cells(h_out, g_out, std::max(edge, size_type{4})-2, std::min(edge+2, n-2));
+            }
+        }
+        return ds;
+    }
+
+
+
+    // Take up to nsteps steps in cycles of up to halo_width steps. The halos are updated along with this process's
+    // cells and stay valid for the whole cycle, so they're exchanged only once at its end, when the ds of each step of
+    // the cycle are summed across processes together. The first step of each cycle is written to h_next and g_next,
+    // which leaves the state from the start of the cycle behind; if ds reaches epsilon partway through the cycle, that
+    // state is restored and stepped forward again to the exact step where ds reached epsilon.
+    value_type deep_multi_step_dsteepness(value_type dt, size_type nsteps) {
+        auto [ds_first, ds_last] = local_ds_range(); // https://tinyurl.com/byusc-structbind
+        auto n = h.size();
+        h_next.resize(n);
+        g_next.resize(n);
+        std::vector<value_type> local_ds(halo_width), global_ds(halo_width);
+
+        value_type ds = 0;
+        for (size_type taken=0; taken<nsteps; taken+=halo_width) {
+            auto cycle_steps = std::min(halo_width, nsteps-taken);
+            auto cycle_t = t;
+
+            // Step through the cycle, exchanging halos before the last step's ds needs them
+            for (size_type s=0; s<cycle_steps; s++) {
+                if (s == 0) {
+                    deep_step(dt, h_next.data(), g_next.data());
+                    std::swap(h, h_next);
+                    std::swap(g, g_next);
+                } else {
+                    deep_step(dt, h.data(), g.data());
+                }
+                if (s == cycle_steps-1) exchange_halos(halo_width, h, g);
+                local_ds[s] = ds_cells(ds_first, ds_last);
+            }
+            {
+                MR_PROFILE_SCOPE(allreduce);
+                comm_world.allreduce(std::plus<>(), local_ds.data(), global_ds.data(),
+                                     mpl::vector_layout<value_type>(cycle_steps));
+            }
+
+            // Find the first step at which ds reached epsilon, replaying the cycle up to it if it isn't the last
+            auto global_ds_taken = std::span(global_ds).first(cycle_steps);
+            auto stop = std::ranges::find_if(global_ds_taken, [](auto x){
+                return !(x > ds_epsilon);
+            });
+            if (stop == global_ds_taken.end()) {
+                ds = global_ds[cycle_steps-1];
+                continue;
+            }
+            auto stop_steps = static_cast<size_type>(stop - global_ds_taken.begin()) + 1;
+            if (stop_steps < cycle_steps) {
+                std::swap(h, h_next);
+                std::swap(g, g_next);
+                t = cycle_t;
+                for (size_type s=0; s<stop_steps; s++) deep_step(dt, h.data(), g.data());
+                exchange_halos(halo_width, h, g);
+            }
+            return *stop;
+        }
+        return ds;
+    }
+
+
+
+    // Update h and g everywhere, including the halos, into h_out and g_out (which can be h and g themselves)
+    void deep_step(value_type dt, value_type *h_out, value_type *g_out) {
+        auto [global_first, global_last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
+        auto n = h.size();
+        local_fused_sweep(dt, h_out, g_out);
+        if (global_first == 0)    g_out[0]   = g_out[1];
+        if (global_last == cells) g_out[n-1] = g_out[n-2];
+        t += dt;
+    }
+
+
+
+    // Update h and g into h_out and g_out (which can be h and g themselves), returning this process's part of the
+    // steepness derivative. The cells of g that neighboring processes need are calculated first, so that the halo
+    // exchange happens while the rest of the cells are being updated.
+    value_type fused_step(value_type dt, array_type &h_out, array_type &g_out) {
+        auto [global_first, global_last] = this_process_cell_range(); // https://tinyurl.com/byusc-structbind
+        auto n = h.size();
+
+        // g at local cell i after this step
+        auto new_g = [&](size_type i) {
+            value_type new_h[3];
+            for (size_type j=0; j<3; j++) new_h[j] = h[i-1+j] + g[i-1+j] * dt;
+            return g_cell(r.data()+i-1, new_h, 1);
+        };
+
+        // Start exchanging halos, receiving into temporaries since g[0] and g[n-1] are still needed for the sweep
+        auto left_tag  = mpl::tag_t{0}, right_tag = mpl::tag_t{1}; // direction of data flow is indicated
+        value_type first_real_cell, last_real_cell, first_halo, last_halo;
+        mpl::irequest_pool requests;
+        if (global_first > 0) {
+            first_real_cell = new_g(1);
+            requests.push(comm_world.isend(first_real_cell, comm_rank-1, left_tag));
+            requests.push(comm_world.irecv(first_halo,      comm_rank-1, right_tag));
+        }
+        if (global_last < cells) {
+            last_real_cell = new_g(n-2);
+            requests.push(comm_world.isend(last_real_cell,  comm_rank+1, right_tag));
+            requests.push(comm_world.irecv(last_halo,       comm_rank+1, left_tag));
+        }
+
+        // Update h and g, calculating ds for cells whose neighbors in g don't depend on halos
+        auto local_ds = local_fused_sweep(dt, h_out.data(), g_out.data());
+        {
+            MR_PROFILE_SCOPE(halo_exchange);
+            requests.waitall();
+        }
+
+        // Fill in halos, using exactly the values neighbors received for the cells next to them, and enforce the
+        // boundary condition
+        if (global_first > 0) {
+            g_out[1] = first_real_cell;
+            g_out[0] = first_halo;
+        } else {
+            g_out[0] = g_out[1];
+        }
+        if (global_last < cells) {
+            g_out[n-2] = last_real_cell;
+            g_out[n-1] = last_halo;
+        } else {
+            g_out[n-1] = g_out[n-2];
+        }
+
+        // Calculate ds for the cells next to the halos
+        auto edge_ds = [&](size_type i){ return ds_cell(h_out.data(), i, g_out[i-1], g_out[i+1]); };
+        for (size_type i=1; i<std::min(size_type{2}, n-1); i++) local_ds += edge_ds(i);
+        for (size_type i=std::max(size_type{2}, n-2); i<n-1; i++) local_ds += edge_ds(i);
+        return local_ds;
+    }
 };
 
 
@@ -3,11 +3,17 @@
 #include <charconv>
 #include <vector>
 #include <array>
+#include <functional>
 #include <ranges>
 #include <thread>
 #include <semaphore>
 #include <atomic>
-#include <barrier>
+#include <chrono>
+#include <map>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "MountainRange.hpp"
 
 
@@ -28,28 +34,302 @@ namespace {
 
 
 
-class MountainRangeThreaded: public MountainRange {
+namespace mr {
+    // The CPUs this process is allowed to run on
+    inline std::vector<int> allowed_cpus() {
+        std::vector<int> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu=0; cpu<CPU_SETSIZE; cpu++) if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+#endif
+        return cpus;
+    }
+
+
+
+    // Pin a thread (or the calling thread if thread is null) to a CPU, returning the socket that CPU is on, or -1 if
+    // pinning isn't supported or the socket can't be determined
+    inline int pin_thread(std::jthread *thread, int cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        auto handle = thread == nullptr ? pthread_self() : thread->native_handle();
+        if (pthread_setaffinity_np(handle, sizeof(set), &set) != 0) return -1;
+        int socket = -1;
+        std::ifstream(std::format("/sys/devices/system/cpu/cpu{}/topology/physical_package_id", cpu)) >> socket;
+        return socket;
+#else
+        return -1;
+#endif
+    }
+
+
+
+    // A barrier for a fixed number of threads. Arriving threads spin for a while before going to sleep, since waiting
+    // on the other threads to finish their part of a step is usually too short to be worth a trip through the OS.
+    // Spinning is skipped if there are more threads than cores, since then the threads being waited on need the core.
+    class spin_barrier {
+        const std::ptrdiff_t count;
+        const int spins;
+        std::atomic<std::ptrdiff_t> arrived{0};
+        std::atomic<size_t> phase{0};
+
+    public:
+        explicit spin_barrier(std::ptrdiff_t count): count{count},
+                spins{count <= static_cast<std::ptrdiff_t>(std::thread::hardware_concurrency()) ? 1 << 12 : 0} {}
+
+        void arrive_and_wait() {
+            auto current_phase = phase.load(std::memory_order_relaxed);
+
+            // The last thread to arrive starts the next phase
+            if (arrived.fetch_add(1, std::memory_order_acq_rel) == count-1) {
+                arrived.store(0, std::memory_order_relaxed);
+                phase.fetch_add(1, std::memory_order_release);
+                phase.notify_all();
+                return;
+            }
+
+            // Everyone else spins, then sleeps
+            for (int i=0; i<spins; i++) {
+                if (phase.load(std::memory_order_acquire) != current_phase) return;
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            while (phase.load(std::memory_order_acquire) == current_phase) {
+                phase.wait(current_phase, std::memory_order_acquire);
+            }
+        }
+    };
+}
+
+
+
+class MountainRangeThreaded final: public MountainRange<double, MountainRangeThreaded> {
+    friend MountainRange; // which calls this class's versions of the functions solving is built from
+
+    // A value on its own cache line, so that threads writing neighboring values don't contend
+    struct alignas(64) padded_value {
+        value_type value;
+    };
+
+
+
+    // What the workers should do on their next iteration
+    enum class job { dsteepness, step, step_dsteepness, temporal_sweep, first_touch, blocks };
+
+
+
     // Threading-related members
     bool continue_iteration; // used to tell the looping threadpool to terminate at the end of the simulation
     const size_type nthreads;
-    std::barrier<> ds_barrier, step_barrier;
-    std::vector<std::jthread> ds_workers, step_workers;
-    std::atomic<value_type> ds_aggregator; // used to reduce dsteepness from each thread
-    value_type iter_dt; // Used to distribute dt to each thread
+    const size_type chunk_size; // 0 means one chunk per thread
+    mr::spin_barrier barrier;
+    std::vector<padded_value> thread_partial_ds; // each thread's part of the steepness derivative
+    std::vector<std::jthread> workers; // nthreads-1 of them, since the main thread does a share of the work too
+    value_type iter_dt;     // Used to distribute dt to each thread
+    size_type iter_nsteps;  // Used to distribute the number of steps per temporal sweep to each thread
+    job iter_job;           // Used to distribute the job to each thread
+    const value_type *iter_src; // Used to distribute the array to copy from when first touching
+    value_type *iter_dst;       // Used to distribute the array to copy to when first touching
+    const std::function<value_type(size_type, size_type)> *iter_blocks; // Used to distribute parallel_max's function
+    std::vector<value_type> thread_ds; // each thread's ds after each step of a temporal sweep
+
+    // Bandwidth measurement members
+    std::vector<int> thread_socket; // socket each thread is pinned to, or -1 if unknown
+    size_type bytes_per_cell = 0;   // bytes of r, h, and g read and written per cell by the jobs run so far
+    std::chrono::duration<double> job_time{0}; // time spent running those jobs
+
+
+
+    // The cells are split into chunks, which are dealt out to threads round-robin; the chunks of a multi-dimensional
+    // range are made of whole planes along its first axis, so that each thread can sweep its planes a tile at a time
+    size_type chunk_unit() const {
+        return ndims > 1 ? std::max(local_strides[0], size_type{1}) : 1;
+    }
+
+    size_type chunk_count() const {
+        auto units = cells / chunk_unit(), units_per_chunk = std::max(chunk_size / chunk_unit(), size_type{1});
+        return chunk_size == 0 ? nthreads : (units + units_per_chunk - 1) / units_per_chunk;
+    }
+
+    auto chunk_range(size_type c) const {
+        auto unit = chunk_unit(), units = cells / unit, units_per_chunk = std::max(chunk_size / unit, size_type{1});
+        auto [first, last] = chunk_size == 0 ? mr::split_range(units, c, nthreads)
+                                             : std::array{c*units_per_chunk, std::min((c+1)*units_per_chunk, units)};
+        return std::array{first*unit, last*unit};
+    }
+
+    // Call F(first, last) for each chunk a certain thread is in charge of
+    void for_each_chunk(size_type tid, auto F) {
+        for (auto c=tid; c<chunk_count(); c+=nthreads) {
+            auto [first, last] = chunk_range(c); // https://tinyurl.com/byusc-structbind
+            F(first, last);
+        }
+    }
+
+
+
+    // Wait partway through a job for every thread to get there
+    void wait_for_all() {
+        MR_PROFILE_SCOPE(barrier_wait);
+        barrier.arrive_and_wait();
+    }
+
+
+
+    // Do this thread's part of iter_job; each job's barrier count must be the same for every thread
+    void work(size_type tid) {
+        switch (iter_job) {
+            case job::dsteepness: {
+                value_type ds_local = 0;
+                for_each_chunk(tid, [&](auto first, auto last){
+                    MR_PROFILE_SCOPE(dsteepness, 2.0 * sizeof(value_type) * (last - first));
+                    if (ndims > 1) {
+                        ds_local += ds_grid(first/chunk_unit(), last/chunk_unit());
+                    } else {
+                        ds_local += ds_cells(std::max(first, size_type{1}), std::min(last, cells-1));
+                    }
+                });
+                thread_partial_ds[tid].value = ds_local;
+                break;
+            }
+            case job::step:
+                for_each_chunk(tid, [&](auto first, auto last){
+                    MR_PROFILE_SCOPE(update_h, 3.0 * sizeof(value_type) * (last - first));
+                    update_h_cells(first, last, iter_dt);
+                });
+                wait_for_all(); // h has to be completely updated before g update can start
+                for_each_chunk(tid, [&](auto first, auto last){
+                    MR_PROFILE_SCOPE(update_g, 3.0 * sizeof(value_type) * (last - first));
+                    if (ndims > 1) {
+                        update_g_grid(first/chunk_unit(), last/chunk_unit());
+                    } else {
+                        update_g_cells(std::max(first, size_type{1}), std::min(last, cells-1));
+                    }
+                });
+                break;
+            case job::step_dsteepness: {
+                value_type ds_local = 0;
+                for_each_chunk(tid, [&](auto first, auto last){
+                    MR_PROFILE_SCOPE(fused_sweep, 5.0 * sizeof(value_type) * (last - first));
+                    ds_local += fused_sweep(first, last, iter_dt);
+                });
+                wait_for_all(); // every sweep has to be done before edges can be cleaned up
+                for_each_chunk(tid, [&](auto first, auto last){
+                    MR_PROFILE_SCOPE(fused_sweep);
+                    ds_local += fused_sweep_edges(first, last);
+                });
+                thread_partial_ds[tid].value = ds_local;
+                break;
+            }
+            case job::first_touch:
+                for_each_chunk(tid, [&](auto first, auto last){
+                    std::copy(iter_src+first, iter_src+last, iter_dst+first);
+                });
+                break;
+            case job::blocks: {
+                value_type largest = 0;
+                for_each_chunk(tid, [&](auto first, auto last){
+                    largest = std::max(largest, (*iter_blocks)(first, last));
+                });
+                thread_partial_ds[tid].value = largest;
+                break;
+            }
+            case job::temporal_sweep: {
+                std::vector<value_type> lh, lg; // scratch space
+                for_each_chunk(tid, [&](auto first, auto last){
+                    MR_PROFILE_SCOPE(temporal_sweep, 5.0 * sizeof(value_type) * (last - first));
+                    for (auto tile_first=first; tile_first<last; tile_first+=temporal_tile_size) {
+                        temporal_tile(tile_first, std::min(tile_first+temporal_tile_size, last), iter_dt, iter_nsteps,
+                                      thread_ds.data()+tid*iter_nsteps, lh, lg);
+                    }
+                });
+                break;
+            }
+        }
+    }
 
 
 
-    // Determine which rows a certain thread is in charge of
-    auto this_thread_cell_range(auto tid) {
-        return mr::split_range(cells, tid, nthreads);
+    // Have the workers and the main thread (as thread 0) run a job, keeping track of the memory traffic it should cause
+    void run(job j) {
+        auto start = std::chrono::steady_clock::now();
+        iter_job = j;
+        barrier.arrive_and_wait(); // signal workers to start
+        work(0);
+        barrier.arrive_and_wait(); // wait for workers to finish
+        if (j == job::first_touch || j == job::blocks) return;
+        job_time += std::chrono::steady_clock::now() - start;
+        bytes_per_cell += sizeof(value_type) * (j == job::dsteepness ? 2     // read h and g
+                                              : j == job::step       ? 6     // h pass then g pass, 3 arrays each
+                                                                     : 5);   // read r, h, and g, write h and g
+    }
+
+
+
+    // Sum the threads' partial steepness derivatives pairwise in a fixed order, so that the result only depends on the
+    // thread count and not on which threads finish first
+    value_type sum_partial_ds() {
+        for (size_type stride=1; stride<nthreads; stride*=2) {
+            for (size_type tid=0; tid+stride<nthreads; tid+=2*stride) {
+                thread_partial_ds[tid].value += thread_partial_ds[tid+stride].value;
+            }
+        }
+        return thread_partial_ds[0].value;
+    }
+
+
+
+protected:
+    // Replace x with a copy whose pages are first touched by the threads that will use them
+    void first_touch(array_type &x) {
+        array_type fresh(x.size()); // not touched yet
+        iter_src = x.data();
+        iter_dst = fresh.data();
+        run(job::first_touch);
+        x.swap(fresh);
+    }
+
+
+
+    // Have each worker run F over its chunks, then take the largest result
+    value_type parallel_max(const std::function<value_type(size_type, size_type)> &F) {
+        iter_blocks = &F;
+        run(job::blocks);
+        value_type largest = 0;
+        for (const auto &partial: thread_partial_ds) largest = std::max(largest, partial.value);
+        return largest;
+    }
+
+
+
+    // Have each worker run temporal_tile over its cells, then sum the results in thread order
+    std::vector<value_type> temporal_sweep(value_type dt, size_type nsteps) {
+        iter_dt = dt;
+        iter_nsteps = nsteps;
+        thread_ds.assign(nthreads*nsteps, 0);
+        run(job::temporal_sweep);
+        std::vector<value_type> ds(nsteps);
+        for (size_type tid=0; tid<nthreads; tid++) {
+            for (size_type s=0; s<nsteps; s++) ds[s] += thread_ds[tid*nsteps+s];
+        }
+        return ds;
     }
 
 
 
 public:
     // Help message to show that SOLVER_NUM_THREADS controls thread counts
-    inline static const std::string help_message =
-            "Set the environment variable SOLVER_NUM_THREADS to a positive integer to set thread count (default 1).";
+    inline static const std::string help_message = MountainRange::help_message + "\n" +
+            "Set the environment variable SOLVER_NUM_THREADS to a positive integer to set thread count (default 1).\n"
+            "Set the environment variable SOLVER_CHUNK_SIZE to a positive integer to deal cells out to threads in chunks "
+            "of that size (default one chunk per thread).\n"
+            "Set the environment variable SOLVER_PIN_THREADS to 1 to pin each thread to its own core and report the "
+            "memory bandwidth of each socket.";
 
 
 
@@ -60,83 +340,117 @@ public:
                 size_type nthreads = 1;
                 auto nthreads_str = std::getenv("SOLVER_NUM_THREADS");
                 if (nthreads_str != nullptr) std::from_chars(nthreads_str, nthreads_str+std::strlen(nthreads_str), nthreads);
-                return nthreads;
+                return std::max(nthreads, size_type{1});
+            }()},
+            chunk_size{[]{
+                size_type chunk_size = 0;
+                auto chunk_size_str = std::getenv("SOLVER_CHUNK_SIZE");
+                if (chunk_size_str != nullptr) {
+                    std::from_chars(chunk_size_str, chunk_size_str+std::strlen(chunk_size_str), chunk_size);
+                }
+                return chunk_size;
             }()},
-            ds_barrier(nthreads+1),   // worker threads plus main thread
-            step_barrier(nthreads+1), // worker threads plus main thread
-            ds_workers(looping_threadpool(nthreads, [this](auto tid){ // https://tinyurl.com/byusc-lambda
-                ds_barrier.arrive_and_wait();
+            barrier(nthreads), // worker threads plus main thread
+            thread_partial_ds(nthreads),
+            workers(looping_threadpool(nthreads-1, [this](auto worker_id){ // https://tinyurl.com/byusc-lambda
+                barrier.arrive_and_wait();
                 if (!continue_iteration) return false;
-                auto [first, last] = this_thread_cell_range(tid);
-                auto gfirst = tid==0 ? 1 : first;
-                auto glast  = tid==nthreads-1 ? last-1 : last;
-                value_type ds_local = 0;
-                for (size_t i=gfirst; i<glast; i++) ds_local += ds_cell(i);
-                ds_aggregator += ds_local;
-                ds_barrier.arrive_and_wait();
+                work(worker_id+1); // the main thread is thread 0
+                barrier.arrive_and_wait();
                 return true;
             })),
-            step_workers(looping_threadpool(nthreads, [this](auto tid){ // https://tinyurl.com/byusc-lambda
-                step_barrier.arrive_and_wait();
-                if (!continue_iteration) return false;
-                auto [first, last] = this_thread_cell_range(tid);
-                auto gfirst = tid==0 ? 1 : first;
-                auto glast  = tid==nthreads-1 ? last-1 : last;
-                for (size_t i=first; i<last; i++) update_h_cell(i, iter_dt);
-                step_barrier.arrive_and_wait(); // h has to be completely updated before g update can start
-                for (size_t i=gfirst; i<glast; i++) update_g_cell(i);
-                step_barrier.arrive_and_wait();
-                return true;
-            })) {
+            thread_socket(nthreads, -1) {
+        // Pin threads to cores if requested
+        auto pin_str = std::getenv("SOLVER_PIN_THREADS");
+        if (pin_str != nullptr && std::string(pin_str) == "1") {
+            auto cpus = mr::allowed_cpus();
+            for (size_type tid=0; tid<nthreads && !cpus.empty(); tid++) {
+                thread_socket[tid] = mr::pin_thread(tid == 0 ? nullptr : &workers[tid-1], cpus[tid % cpus.size()]);
+            }
+        }
+
+        // Move r, h, and g to memory that each thread touches first, so it lives on that thread's socket
+        first_touch_r();
+        first_touch(h);
+        first_touch(g);
+
         // Initialize g
         step(0);
     }
 
 
 
+    // Describe the effective memory bandwidth of each socket's threads so far, counting the traffic each job would cause
+    // if nothing were cached; empty unless threads were pinned
+    std::string bandwidth_report() const {
+        std::map<int, size_type> socket_cells;
+        for (size_type tid=0; tid<nthreads; tid++) {
+            if (thread_socket[tid] < 0) return "";
+            for (auto c=tid; c<chunk_count(); c+=nthreads) {
+                auto [first, last] = chunk_range(c); // https://tinyurl.com/byusc-structbind
+                socket_cells[thread_socket[tid]] += last - first;
+            }
+        }
+        std::string report;
+        for (auto [socket, socket_cell_count]: socket_cells) {
+            auto bandwidth = socket_cell_count * bytes_per_cell / job_time.count() / 1e9;
+            report += std::format("{}Socket {}: {:.2f} GB/s", report.empty() ? "" : "\n", socket, bandwidth);
+        }
+        return report;
+    }
+
+
+
     // Destructor just tells threads to exit
     ~MountainRangeThreaded() {
         continue_iteration = false;
-        ds_barrier.arrive_and_wait();   // signal ds_workers to exit
-        step_barrier.arrive_and_wait(); // signal step_workers to exit
+        barrier.arrive_and_wait(); // signal workers to exit
     }
 
 
 
     // Steepness derivative
-    value_type dsteepness() override {
-        // Reset reduction destination
-        ds_aggregator = 0;
-        
-        // Launch workers
-        ds_barrier.arrive_and_wait();
+    value_type dsteepness() {
+        // Have workers calculate their part, then add the parts up
+        run(job::dsteepness);
+        return sum_partial_ds();
+    }
 
-        // Wait for workers to finish this iteration
-        ds_barrier.arrive_and_wait(); 
 
-        return ds_aggregator;
-    }
 
     // Iterate from t to t+dt in one step
-    value_type step(value_type dt) override {
+    value_type step(value_type dt) {
         // Let threads know what the time step this iteration is
         iter_dt = dt;
 
-        // Signal workers to update h
-        step_barrier.arrive_and_wait();
-
-        // Signal workers to update g
-        step_barrier.arrive_and_wait();
-
-        // Wait for workers to finish this iteration
-        step_barrier.arrive_and_wait();
+        // Have workers update h, then g
+        run(job::step);
 
-        // Enforce boundary condition
-        g[0] = g[1];
-        g[cells-1] = g[cells-2];
+        // Enforce boundary condition; g just stays 0 on the boundary of a multi-dimensional range
+        if (ndims == 1) {
+            g[0] = g[1];
+            g[cells-1] = g[cells-2];
+        }
 
         // Increment and return dt
         t += dt;
         return t;
     }
+
+
+
+    // Iterate from t to t+dt and calculate the new steepness derivative with one pass through memory
+    value_type step_dsteepness(value_type dt) {
+        if (ndims > 1) return MountainRange::step_dsteepness(dt);
+
+        // Let threads know what the time step this iteration is
+        iter_dt = dt;
+
+        // Have workers sweep, then clean up edges (including the boundary condition)
+        run(job::step_dsteepness);
+
+        // Increment time and return steepness derivative
+        t += dt;
+        return sum_partial_ds();
+    }
 };
@@ -0,0 +1,455 @@
+#pragma once
+#include <cstddef>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <type_traits>
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__)) && !defined(__NVCOMPILER)
+#define MR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+
+
+// Vectorized loops for stepping and calculating the steepness derivative, shared by every MountainRange implementation.
+// The widest kernels the CPU supports are chosen at startup; scalar kernels are used everywhere else. Results can
+// differ between kernels in the last bit or so, since the compiler may fuse multiplies and adds where FMA is available
+// and the ds sum is done in a different order.
+//
+// There are kernels for ranges stored as doubles and as floats. Float kernels step in single precision, which halves
+// the memory traffic, but calculate ds terms and sum them in double precision with Kahan summation, so that the
+// stopping criterion isn't at the mercy of single-precision rounding.
+
+
+
+namespace mr::kernels {
+    // Scalar kernels, also used for the cells left over after the last full vector
+    template <class T>
+    inline void update_h_scalar(T *h_out, const T *h, const T *g, size_t first, size_t last, double dt) {
+        for (auto i=first; i<last; i++) h_out[i] = h[i] + g[i] * T(dt);
+    }
+
+    template <class T>
+    inline void update_g_scalar(const T *r, const T *h, T *g, size_t first, size_t last) {
+        for (auto i=first; i<last; i++) g[i] = r[i] - h[i]*h[i]*h[i] + ((h[i-1] + h[i+1]) / 2 - h[i]);
+    }
+
+    // Sum of (h[i-1]-h[i+1])*(g[i-1]-g[i+1]) over [first, last), with four accumulators to hide addition latency
+    inline double ds_sum_scalar(const double *h, const double *g, size_t first, size_t last) {
+        double acc[4] = {};
+        auto i = first;
+        for (; i+4<=last; i+=4) {
+            for (size_t j=0; j<4; j++) acc[j] += (h[i+j-1] - h[i+j+1]) * (g[i+j-1] - g[i+j+1]);
+        }
+        for (; i<last; i++) acc[0] += (h[i-1] - h[i+1]) * (g[i-1] - g[i+1]);
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+    // Add x to sum, keeping the rounding error of the addition in c (Kahan summation); the true sum is sum - c
+    inline void kahan_add(double &sum, double &c, double x) {
+        auto y = x - c;
+        auto t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+
+    // Total of n Kahan sums and their errors
+    inline double kahan_total(const double *sums, const double *cs, size_t n) {
+        double total = 0, c = 0;
+        for (size_t j=0; j<n; j++) {
+            kahan_add(total, c, sums[j]);
+            kahan_add(total, c, -cs[j]);
+        }
+        return total - c;
+    }
+
+    // ds_sum for floats, with each term calculated and summed in double precision
+    inline double ds_sum_scalar(const float *h, const float *g, size_t first, size_t last) {
+        double sums[4] = {}, cs[4] = {};
+        auto term = [h, g](size_t i){ return (double(h[i-1]) - h[i+1]) * (double(g[i-1]) - g[i+1]); };
+        auto i = first;
+        for (; i+4<=last; i+=4) {
+            for (size_t j=0; j<4; j++) kahan_add(sums[j], cs[j], term(i+j));
+        }
+        for (; i<last; i++) kahan_add(sums[0], cs[0], term(i));
+        return kahan_total(sums, cs, 4);
+    }
+
+    // Versions of update_g and ds_sum for interleaved ranges, whose neighboring cells are stride apart; instead of
+    // being summed, each i's ds term is added to acc[i-first]
+    template <class T>
+    inline void update_g_strided_scalar(const T *r, const T *h, T *g, size_t first, size_t last, size_t stride) {
+        for (auto i=first; i<last; i++) {
+            g[i] = r[i] - h[i]*h[i]*h[i] + ((h[i-stride] + h[i+stride]) / 2 - h[i]);
+        }
+    }
+
+    template <class T>
+    inline void ds_add_strided_scalar(const T *h, const T *g, double *acc, size_t first, size_t last, size_t stride) {
+        for (auto i=first; i<last; i++) {
+            acc[i-first] += (double(h[i-stride]) - h[i+stride]) * (double(g[i-stride]) - g[i+stride]);
+        }
+    }
+
+
+
+#ifdef MR_X86_SIMD
+    // AVX2 kernels: 4 doubles per vector
+    [[gnu::target("avx2")]] inline void update_h_avx2(double *h_out, const double *h, const double *g, size_t first,
+                                                       size_t last, double dt) {
+        auto vdt = _mm256_set1_pd(dt);
+        auto i = first;
+        for (; i+4<=last; i+=4) {
+            _mm256_storeu_pd(h_out+i, _mm256_add_pd(_mm256_loadu_pd(h+i), _mm256_mul_pd(_mm256_loadu_pd(g+i), vdt)));
+        }
+        update_h_scalar(h_out, h, g, i, last, dt);
+    }
+
+    [[gnu::target("avx2")]] inline void update_g_avx2(const double *r, const double *h, double *g, size_t first,
+                                                       size_t last) {
+        auto half = _mm256_set1_pd(0.5);
+        auto i = first;
+        for (; i+4<=last; i+=4) {
+            auto hc = _mm256_loadu_pd(h+i);
+            auto hn = _mm256_add_pd(_mm256_loadu_pd(h+i-1), _mm256_loadu_pd(h+i+1));
+            auto L  = _mm256_sub_pd(_mm256_mul_pd(hn, half), hc);
+            auto h3 = _mm256_mul_pd(_mm256_mul_pd(hc, hc), hc);
+            _mm256_storeu_pd(g+i, _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(r+i), h3), L));
+        }
+        update_g_scalar(r, h, g, i, last);
+    }
+
+    [[gnu::target("avx2")]] inline __m256d ds_terms_avx2(const double *h, const double *g, size_t i) {
+        return _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(h+i-1), _mm256_loadu_pd(h+i+1)),
+                             _mm256_sub_pd(_mm256_loadu_pd(g+i-1), _mm256_loadu_pd(g+i+1)));
+    }
+
+    [[gnu::target("avx2")]] inline double ds_sum_avx2(const double *h, const double *g, size_t first, size_t last) {
+        __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+        auto i = first;
+        for (; i+16<=last; i+=16) {
+            for (size_t j=0; j<4; j++) acc[j] = _mm256_add_pd(acc[j], ds_terms_avx2(h, g, i+4*j));
+        }
+        for (; i+4<=last; i+=4) acc[0] = _mm256_add_pd(acc[0], ds_terms_avx2(h, g, i));
+        alignas(32) double lanes[4];
+        _mm256_store_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc[0], acc[1]), _mm256_add_pd(acc[2], acc[3])));
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + ds_sum_scalar(h, g, i, last);
+    }
+
+    [[gnu::target("avx2")]] inline void update_g_strided_avx2(const double *r, const double *h, double *g,
+                                                               size_t first, size_t last, size_t stride) {
+        auto half = _mm256_set1_pd(0.5);
+        auto i = first;
+        for (; i+4<=last; i+=4) {
+            auto hc = _mm256_loadu_pd(h+i);
+            auto hn = _mm256_add_pd(_mm256_loadu_pd(h+i-stride), _mm256_loadu_pd(h+i+stride));
+            auto L  = _mm256_sub_pd(_mm256_mul_pd(hn, half), hc);
+            auto h3 = _mm256_mul_pd(_mm256_mul_pd(hc, hc), hc);
+            _mm256_storeu_pd(g+i, _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(r+i), h3), L));
+        }
+        update_g_strided_scalar(r, h, g, i, last, stride);
+    }
+
+    [[gnu::target("avx2")]] inline void ds_add_strided_avx2(const double *h, const double *g, double *acc,
+                                                             size_t first, size_t last, size_t stride) {
+        auto i = first;
+        for (; i+4<=last; i+=4) {
+            auto terms = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(h+i-stride), _mm256_loadu_pd(h+i+stride)),
+                                       _mm256_sub_pd(_mm256_loadu_pd(g+i-stride), _mm256_loadu_pd(g+i+stride)));
+            _mm256_storeu_pd(acc+i-first, _mm256_add_pd(_mm256_loadu_pd(acc+i-first), terms));
+        }
+        ds_add_strided_scalar(h, g, acc+i-first, i, last, stride);
+    }
+
+    // Add each lane of x to sum with Kahan summation
+    [[gnu::target("avx2")]] inline void kahan_add_avx2(__m256d &sum, __m256d &c, __m256d x) {
+        auto y = _mm256_sub_pd(x, c);
+        auto t = _mm256_add_pd(sum, y);
+        c = _mm256_sub_pd(_mm256_sub_pd(t, sum), y);
+        sum = t;
+    }
+
+    // AVX2 float kernels: 8 floats per vector for stepping, 4 cells per vector of double ds terms
+    [[gnu::target("avx2")]] inline void update_h_avx2(float *h_out, const float *h, const float *g, size_t first,
+                                                       size_t last, double dt) {
+        auto vdt = _mm256_set1_ps(float(dt));
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            _mm256_storeu_ps(h_out+i, _mm256_add_ps(_mm256_loadu_ps(h+i), _mm256_mul_ps(_mm256_loadu_ps(g+i), vdt)));
+        }
+        update_h_scalar(h_out, h, g, i, last, dt);
+    }
+
+    [[gnu::target("avx2")]] inline void update_g_avx2(const float *r, const float *h, float *g, size_t first,
+                                                       size_t last) {
+        auto half = _mm256_set1_ps(0.5f);
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            auto hc = _mm256_loadu_ps(h+i);
+            auto hn = _mm256_add_ps(_mm256_loadu_ps(h+i-1), _mm256_loadu_ps(h+i+1));
+            auto L  = _mm256_sub_ps(_mm256_mul_ps(hn, half), hc);
+            auto h3 = _mm256_mul_ps(_mm256_mul_ps(hc, hc), hc);
+            _mm256_storeu_ps(g+i, _mm256_add_ps(_mm256_sub_ps(_mm256_loadu_ps(r+i), h3), L));
+        }
+        update_g_scalar(r, h, g, i, last);
+    }
+
+    [[gnu::target("avx2")]] inline __m256d load_as_pd_avx2(const float *p) {
+        return _mm256_cvtps_pd(_mm_loadu_ps(p));
+    }
+
+    [[gnu::target("avx2")]] inline __m256d ds_terms_avx2(const float *h, const float *g, size_t i) {
+        return _mm256_mul_pd(_mm256_sub_pd(load_as_pd_avx2(h+i-1), load_as_pd_avx2(h+i+1)),
+                             _mm256_sub_pd(load_as_pd_avx2(g+i-1), load_as_pd_avx2(g+i+1)));
+    }
+
+    [[gnu::target("avx2")]] inline double ds_sum_avx2(const float *h, const float *g, size_t first, size_t last) {
+        __m256d sums[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()}, cs[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            for (size_t j=0; j<2; j++) kahan_add_avx2(sums[j], cs[j], ds_terms_avx2(h, g, i+4*j));
+        }
+        alignas(32) double lane_sums[10], lane_cs[10] = {};
+        for (size_t j=0; j<2; j++) {
+            _mm256_store_pd(lane_sums+4*j, sums[j]);
+            _mm256_store_pd(lane_cs+4*j, cs[j]);
+        }
+        lane_sums[8] = ds_sum_scalar(h, g, i, last);
+        return kahan_total(lane_sums, lane_cs, 9);
+    }
+
+
+
+    // AVX-512 kernels: 8 doubles per vector
+    [[gnu::target("avx512f")]] inline void update_h_avx512(double *h_out, const double *h, const double *g,
+                                                            size_t first, size_t last, double dt) {
+        auto vdt = _mm512_set1_pd(dt);
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            _mm512_storeu_pd(h_out+i, _mm512_add_pd(_mm512_loadu_pd(h+i), _mm512_mul_pd(_mm512_loadu_pd(g+i), vdt)));
+        }
+        update_h_scalar(h_out, h, g, i, last, dt);
+    }
+
+    [[gnu::target("avx512f")]] inline void update_g_avx512(const double *r, const double *h, double *g, size_t first,
+                                                            size_t last) {
+        auto half = _mm512_set1_pd(0.5);
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            auto hc = _mm512_loadu_pd(h+i);
+            auto hn = _mm512_add_pd(_mm512_loadu_pd(h+i-1), _mm512_loadu_pd(h+i+1));
+            auto L  = _mm512_sub_pd(_mm512_mul_pd(hn, half), hc);
+            auto h3 = _mm512_mul_pd(_mm512_mul_pd(hc, hc), hc);
+            _mm512_storeu_pd(g+i, _mm512_add_pd(_mm512_sub_pd(_mm512_loadu_pd(r+i), h3), L));
+        }
+        update_g_scalar(r, h, g, i, last);
+    }
+
+    [[gnu::target("avx512f")]] inline __m512d ds_terms_avx512(const double *h, const double *g, size_t i) {
+        return _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(h+i-1), _mm512_loadu_pd(h+i+1)),
+                             _mm512_sub_pd(_mm512_loadu_pd(g+i-1), _mm512_loadu_pd(g+i+1)));
+    }
+
+    [[gnu::target("avx512f")]] inline double ds_sum_avx512(const double *h, const double *g, size_t first,
+                                                            size_t last) {
+        __m512d acc[4] = {_mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd()};
+        auto i = first;
+        for (; i+32<=last; i+=32) {
+            for (size_t j=0; j<4; j++) acc[j] = _mm512_add_pd(acc[j], ds_terms_avx512(h, g, i+8*j));
+        }
+        for (; i+8<=last; i+=8) acc[0] = _mm512_add_pd(acc[0], ds_terms_avx512(h, g, i));
+        auto sum = _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(acc[0], acc[1]), _mm512_add_pd(acc[2], acc[3])));
+        return sum + ds_sum_scalar(h, g, i, last);
+    }
+
+    [[gnu::target("avx512f")]] inline void update_g_strided_avx512(const double *r, const double *h, double *g,
+                                                                    size_t first, size_t last, size_t stride) {
+        auto half = _mm512_set1_pd(0.5);
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            auto hc = _mm512_loadu_pd(h+i);
+            auto hn = _mm512_add_pd(_mm512_loadu_pd(h+i-stride), _mm512_loadu_pd(h+i+stride));
+            auto L  = _mm512_sub_pd(_mm512_mul_pd(hn, half), hc);
+            auto h3 = _mm512_mul_pd(_mm512_mul_pd(hc, hc), hc);
+            _mm512_storeu_pd(g+i, _mm512_add_pd(_mm512_sub_pd(_mm512_loadu_pd(r+i), h3), L));
+        }
+        update_g_strided_scalar(r, h, g, i, last, stride);
+    }
+
+    [[gnu::target("avx512f")]] inline void ds_add_strided_avx512(const double *h, const double *g, double *acc,
+                                                                  size_t first, size_t last, size_t stride) {
+        auto i = first;
+        for (; i+8<=last; i+=8) {
+            auto terms = _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(h+i-stride), _mm512_loadu_pd(h+i+stride)),
+                                       _mm512_sub_pd(_mm512_loadu_pd(g+i-stride), _mm512_loadu_pd(g+i+stride)));
+            _mm512_storeu_pd(acc+i-first, _mm512_add_pd(_mm512_loadu_pd(acc+i-first), terms));
+        }
+        ds_add_strided_scalar(h, g, acc+i-first, i, last, stride);
+    }
+
+    // Add each lane of x to sum with Kahan summation
+    [[gnu::target("avx512f")]] inline void kahan_add_avx512(__m512d &sum, __m512d &c, __m512d x) {
+        auto y = _mm512_sub_pd(x, c);
+        auto t = _mm512_add_pd(sum, y);
+        c = _mm512_sub_pd(_mm512_sub_pd(t, sum), y);
+        sum = t;
+    }
+
+    // AVX-512 float kernels: 16 floats per vector for stepping, 8 cells per vector of double ds terms
+    [[gnu::target("avx512f")]] inline void update_h_avx512(float *h_out, const float *h, const float *g, size_t first,
+                                                            size_t last, double dt) {
+        auto vdt = _mm512_set1_ps(float(dt));
+        auto i = first;
+        for (; i+16<=last; i+=16) {
+            _mm512_storeu_ps(h_out+i, _mm512_add_ps(_mm512_loadu_ps(h+i), _mm512_mul_ps(_mm512_loadu_ps(g+i), vdt)));
+        }
+        update_h_scalar(h_out, h, g, i, last, dt);
+    }
+
+    [[gnu::target("avx512f")]] inline void update_g_avx512(const float *r, const float *h, float *g, size_t first,
+                                                            size_t last) {
+        auto half = _mm512_set1_ps(0.5f);
+        auto i = first;
+        for (; i+16<=last; i+=16) {
+            auto hc = _mm512_loadu_ps(h+i);
+            auto hn = _mm512_add_ps(_mm512_loadu_ps(h+i-1), _mm512_loadu_ps(h+i+1));
+            auto L  = _mm512_sub_ps(_mm512_mul_ps(hn, half), hc);
+            auto h3 = _mm512_mul_ps(_mm512_mul_ps(hc, hc), hc);
+            _mm512_storeu_ps(g+i, _mm512_add_ps(_mm512_sub_ps(_mm512_loadu_ps(r+i), h3), L));
+        }
+        update_g_scalar(r, h, g, i, last);
+    }
+
+    [[gnu::target("avx512f")]] inline __m512d load_as_pd_avx512(const float *p) {
+        return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+    }
+
+    [[gnu::target("avx512f")]] inline __m512d ds_terms_avx512(const float *h, const float *g, size_t i) {
+        return _mm512_mul_pd(_mm512_sub_pd(load_as_pd_avx512(h+i-1), load_as_pd_avx512(h+i+1)),
+                             _mm512_sub_pd(load_as_pd_avx512(g+i-1), load_as_pd_avx512(g+i+1)));
+    }
+
+    [[gnu::target("avx512f")]] inline double ds_sum_avx512(const float *h, const float *g, size_t first,
+                                                            size_t last) {
+        __m512d sums[2] = {_mm512_setzero_pd(), _mm512_setzero_pd()}, cs[2] = {_mm512_setzero_pd(), _mm512_setzero_pd()};
+        auto i = first;
+        for (; i+16<=last; i+=16) {
+            for (size_t j=0; j<2; j++) kahan_add_avx512(sums[j], cs[j], ds_terms_avx512(h, g, i+8*j));
+        }
+        alignas(64) double lane_sums[18], lane_cs[18] = {};
+        for (size_t j=0; j<2; j++) {
+            _mm512_store_pd(lane_sums+8*j, sums[j]);
+            _mm512_store_pd(lane_cs+8*j, cs[j]);
+        }
+        lane_sums[16] = ds_sum_scalar(h, g, i, last);
+        return kahan_total(lane_sums, lane_cs, 17);
+    }
+#endif
+
+
+
+    // A set of kernels for one instruction set and storage type T
+    template <class T>
+    struct kernel_set {
+        const char *name;
+        void   (*update_h)(T *h_out, const T *h, const T *g, size_t first, size_t last, double dt);
+        void   (*update_g)(const T *r, const T *h, T *g, size_t first, size_t last);
+        double (*ds_sum)(const T *h, const T *g, size_t first, size_t last);
+        void   (*update_g_strided)(const T *r, const T *h, T *g, size_t first, size_t last, size_t stride);
+        void   (*ds_add_strided)(const T *h, const T *g, double *acc, size_t first, size_t last, size_t stride);
+    };
+
+    template <class T>
+    inline constexpr kernel_set<T> scalar{"scalar", update_h_scalar<T>, update_g_scalar<T>, ds_sum_scalar,
+                                          update_g_strided_scalar<T>, ds_add_strided_scalar<T>};
+#ifdef MR_X86_SIMD
+    // Interleaved ranges are only stored as doubles, so float kernel sets fall back on scalar strided kernels
+    template <class T>
+    inline constexpr kernel_set<T> avx2{"avx2", update_h_avx2, update_g_avx2, ds_sum_avx2,
+                                        update_g_strided_scalar<T>, ds_add_strided_scalar<T>};
+    template <>
+    inline constexpr kernel_set<double> avx2<double>{"avx2", update_h_avx2, update_g_avx2, ds_sum_avx2,
+                                                     update_g_strided_avx2, ds_add_strided_avx2};
+    template <class T>
+    inline constexpr kernel_set<T> avx512{"avx512", update_h_avx512, update_g_avx512, ds_sum_avx512,
+                                          update_g_strided_scalar<T>, ds_add_strided_scalar<T>};
+    template <>
+    inline constexpr kernel_set<double> avx512<double>{"avx512", update_h_avx512, update_g_avx512, ds_sum_avx512,
+                                                       update_g_strided_avx512, ds_add_strided_avx512};
+#endif
+
+
+
+    // Choose the widest kernels this CPU supports, or narrower ones if the environment variable SOLVER_SIMD is set to
+    // scalar or avx2
+    template <class T>
+    inline const kernel_set<T> &select() {
+        auto requested_str = std::getenv("SOLVER_SIMD");
+        auto requested = std::string(requested_str == nullptr ? "avx512" : requested_str);
+#ifdef MR_X86_SIMD
+        __builtin_cpu_init();
+        if (requested == "avx512" && __builtin_cpu_supports("avx512f")) return avx512<T>;
+        if ((requested == "avx512" || requested == "avx2") && __builtin_cpu_supports("avx2")) return avx2<T>;
+#endif
+        return scalar<T>;
+    }
+
+    // The kernels in use for each storage type
+    template <class T=double>
+    inline const kernel_set<T> &active = select<T>();
+
+
+
+    // Kernels for a row of an N-dimensional range, which runs along its last axis; a cell's neighbors along axis a are
+    // strides[a] away, with strides[ndims-1] being 1. Each builds up its result an axis at a time, in the same order as
+    // Mountains.jl, so that every pass is a simple loop the compiler can vectorize no matter how many dimensions there
+    // are. Rows are short enough to stay in L1 cache between passes.
+    template <class T>
+    inline void update_g_grid(const T *r, const T *h, T *g, size_t first, size_t last, const size_t *strides,
+                              size_t ndims) {
+        for (auto i=first; i<last; i++) g[i] = -T(ndims) * h[i];
+        for (size_t a=0; a<ndims; a++) {
+            auto s = strides[a];
+            for (auto i=first; i<last; i++) g[i] += (h[i-s] + h[i+s]) / 2;
+        }
+        for (auto i=first; i<last; i++) g[i] = r[i] - h[i]*h[i]*h[i] + g[i];
+    }
+
+    // Sum over a row of the product of the sums of (h[i-s]-h[i+s]) and (g[i-s]-g[i+s]) over every axis, calculated in
+    // double precision a chunk of the row at a time; terms go to four accumulators as in ds_sum_scalar, and float
+    // terms are summed with Kahan summation
+    template <class T>
+    inline double ds_sum_grid(const T *h, const T *g, size_t first, size_t last, const size_t *strides,
+                              size_t ndims) {
+        constexpr size_t chunk_size = 256;
+        double dh[chunk_size], dg[chunk_size], sums[4] = {}, cs[4] = {};
+        auto add = [&sums, &cs](size_t j, double x){
+            if constexpr (std::is_same_v<T, double>) {
+                sums[j] += x;
+            } else {
+                kahan_add(sums[j], cs[j], x);
+            }
+        };
+        for (auto chunk_first=first; chunk_first<last; chunk_first+=chunk_size) {
+            auto n = std::min(chunk_size, last-chunk_first);
+            auto ch = h + chunk_first, cg = g + chunk_first;
+            std::fill_n(dh, n, 0.0);
+            std::fill_n(dg, n, 0.0);
+            for (size_t a=0; a<ndims; a++) {
+                auto h_below = ch - strides[a], h_above = ch + strides[a];
+                auto g_below = cg - strides[a], g_above = cg + strides[a];
+                for (size_t i=0; i<n; i++) {
+                    dh[i] += double(h_below[i]) - h_above[i];
+                    dg[i] += double(g_below[i]) - g_above[i];
+                }
+            }
+            size_t i = 0;
+            for (; i+4<=n; i+=4) {
+                for (size_t j=0; j<4; j++) add(j, dh[i+j] * dg[i+j]);
+            }
+            for (; i<n; i++) add(0, dh[i] * dg[i]);
+        }
+        if constexpr (std::is_same_v<T, double>) return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+        return kahan_total(sums, cs, 4);
+    }
+}
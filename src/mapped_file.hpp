@@ -0,0 +1,131 @@
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <filesystem>
+#include <system_error>
+#if __has_include(<sys/mman.h>)
+#define MR_HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+
+// Files mapped into memory, so that MountainRange can use an input file's contents in place and write output without
+// staging it in a stream buffer. Mapping is only used if the environment variable SOLVER_MMAP is set to 1 and the
+// platform supports it.
+
+
+
+namespace mr {
+    // Whether files should be mapped rather than streamed
+    inline bool mmap_requested() {
+#ifdef MR_HAVE_MMAP
+        auto mmap_str = std::getenv("SOLVER_MMAP");
+        return mmap_str != nullptr && std::string(mmap_str) == "1";
+#else
+        return false;
+#endif
+    }
+
+
+
+#ifdef MR_HAVE_MMAP
+    // A whole file mapped into memory, unmapped on destruction. Errors are thrown as std::filesystem::filesystem_error.
+    class mapped_file {
+        std::byte *addr = nullptr;
+        size_t length = 0;
+        std::string target, staging; // for files mapped for writing, the file to write and where it's staged until then
+
+        [[noreturn]] static void fail(const char *what, const char *filename) {
+            throw std::filesystem::filesystem_error(what, filename, std::error_code(errno, std::generic_category()));
+        }
+
+        // Map length bytes of the open file fd, closing fd either way
+        void map(int fd, int prot, int flags, const char *filename) {
+            addr = static_cast<std::byte *>(mmap(nullptr, length, prot, flags, fd, 0));
+            close(fd);
+            if (addr == MAP_FAILED) {
+                addr = nullptr;
+                fail("mmap", filename);
+            }
+        }
+
+    public:
+        // Map an existing file read-only; pages are read in as they're first used
+        explicit mapped_file(const char *filename) {
+            auto fd = open(filename, O_RDONLY);
+            if (fd < 0) fail("open", filename);
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                fail("fstat", filename);
+            }
+            length = st.st_size;
+            map(fd, PROT_READ, MAP_PRIVATE, filename);
+            madvise(addr, length, MADV_SEQUENTIAL);
+        }
+
+        // Create a file of size bytes next to filename and map it for writing; what's written to the mapping replaces
+        // filename once commit is called. It's staged rather than written in place since filename may be mapped as
+        // the input, whose contents (r in particular) are still being copied out.
+        mapped_file(const char *filename, size_t size): length{size}, target{filename},
+                                                        staging{target + ".writing-" + std::to_string(getpid())} {
+            auto fd = open(staging.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+            if (fd < 0) fail("open", filename);
+            if (ftruncate(fd, length) != 0) {
+                close(fd);
+                unlink(staging.c_str());
+                fail("ftruncate", filename);
+            }
+            try {
+                map(fd, PROT_READ | PROT_WRITE, MAP_SHARED, filename);
+            } catch (...) {
+                unlink(staging.c_str());
+                throw;
+            }
+        }
+
+        // Unmap a file mapped for writing and move it into place
+        void commit() {
+            munmap(addr, length);
+            addr = nullptr;
+            if (rename(staging.c_str(), target.c_str()) != 0) {
+                unlink(staging.c_str());
+                fail("rename", target.c_str());
+            }
+            staging.clear();
+        }
+
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        ~mapped_file() {
+            if (addr != nullptr) munmap(addr, length);
+            if (!staging.empty()) unlink(staging.c_str()); // never committed
+        }
+
+        // Accessors
+        auto size() const { return length; }
+        auto data()       { return addr; }
+        auto data() const { return static_cast<const std::byte *>(addr); }
+    };
+#else
+    // Stand-in for platforms without mmap, never constructed since mmap_requested() is always false
+    class mapped_file {
+    public:
+        explicit mapped_file(const char *filename) {
+            throw std::filesystem::filesystem_error("mmap", filename, std::make_error_code(std::errc::not_supported));
+        }
+        mapped_file(const char *filename, size_t size): mapped_file(filename) {}
+        void commit() {}
+        size_t size() const { return 0; }
+        std::byte *data() { return nullptr; }
+        const std::byte *data() const { return nullptr; }
+    };
+#endif
+}
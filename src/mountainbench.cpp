@@ -0,0 +1,240 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <format>
+#ifdef MPI_VERSION
+#include <mpl/mpl.hpp>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_STDPAR
+#include <optional>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#endif
+
+
+
+// Compile with the same flags as mountainsolve to benchmark the same implementation
+#if defined(USE_OPENMP)
+#include "MountainRange.hpp"
+using MtnRange = MountainRange<>;
+#elif defined(USE_FLOAT)
+#include "MountainRange.hpp"
+using MtnRange = MountainRange<float>;
+#elif defined(USE_THREAD)
+#include "MountainRangeThreaded.hpp"
+using MtnRange = MountainRangeThreaded;
+#elif defined(USE_GPU) || defined(USE_STDPAR)
+#include "MountainRangeGPU.hpp"
+using MtnRange = MountainRangeGPU;
+#elif defined(USE_MPI)
+#include "MountainRangeMPI.hpp"
+using MtnRange = MountainRangeMPI;
+#endif
+
+
+
+// Benchmark step, dsteepness, and solve on synthetic mountain ranges ranging from small enough to fit in L1 cache to
+// big enough to be bound by DRAM bandwidth, with each thread count up to the number available. Results are printed as
+// CSV, one line per measurement; bench/mountainbench.sh runs this for each backend and rank count, then calculates
+// parallel efficiency and checks for regressions.
+
+
+
+namespace {
+    using value_type   = MtnRange::value_type;
+    using storage_type = MtnRange::storage_type;
+
+    // Benchmark parameters
+    constexpr value_type dt = 0.01;
+    constexpr size_t min_cells = 1 << 10;          // r, h, and g fit in L1
+    constexpr size_t default_max_cells = 1 << 24;  // r, h, and g are several times bigger than any L3
+    constexpr size_t updates_per_trial = 1 << 27;  // cell updates per timed trial of step and dsteepness
+    constexpr size_t cells_per_solve = 1 << 20;    // small ranges are solved in more trials, since solving is quick
+    constexpr size_t trials = 3;                   // the fastest trial is reported
+
+    // Bytes each operation moves per cell: step reads h and g to update h then r and h to update g, dsteepness reads
+    // h and g, and each step of solve is a fused sweep that reads r, h, and g and writes h and g
+    constexpr size_t step_bytes  = 6 * sizeof(storage_type);
+    constexpr size_t ds_bytes    = 2 * sizeof(storage_type);
+    constexpr size_t solve_bytes = 5 * sizeof(storage_type);
+
+    // Name of the implementation being benchmarked
+#if defined(USE_FLOAT)
+    const std::string backend = "float";
+#elif defined(USE_THREAD)
+    const std::string backend = "thread";
+#elif defined(USE_GPU)
+    const std::string backend = "gpu";
+#elif defined(USE_STDPAR)
+    const std::string backend = "stdpar";
+#elif defined(MPI_VERSION) && defined(_OPENMP)
+    const std::string backend = "hybrid";
+#elif defined(MPI_VERSION)
+    const std::string backend = "mpi";
+#elif defined(_OPENMP)
+    const std::string backend = "openmp";
+#else
+    const std::string backend = "serial";
+#endif
+
+
+
+    // Process rank and count, which are 0 and 1 without MPI
+    int rank() {
+#ifdef MPI_VERSION
+        return mpl::environment::comm_world().rank();
+#else
+        return 0;
+#endif
+    }
+    int ranks() {
+#ifdef MPI_VERSION
+        return mpl::environment::comm_world().size();
+#else
+        return 1;
+#endif
+    }
+
+    // Wait for every process
+    void barrier() {
+#ifdef MPI_VERSION
+        mpl::environment::comm_world().barrier();
+#endif
+    }
+
+
+
+    // Thread counts to sweep: powers of 2 up to the number of threads available, and that number itself
+    std::vector<int> thread_counts() {
+#if defined(_OPENMP)
+        int max_threads = omp_get_max_threads();
+#elif defined(USE_THREAD)
+        int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        auto nthreads_str = std::getenv("SOLVER_NUM_THREADS");
+        if (nthreads_str != nullptr) std::from_chars(nthreads_str, nthreads_str+std::strlen(nthreads_str), max_threads);
+#elif defined(USE_STDPAR)
+        int max_threads = tbb::this_task_arena::max_concurrency();
+#else
+        int max_threads = 1;
+#endif
+        std::vector<int> counts;
+        for (int n=1; n<max_threads; n*=2) counts.push_back(n);
+        counts.push_back(max_threads);
+        return counts;
+    }
+
+    // Make ranges constructed from now on use nthreads threads
+    void use_threads([[maybe_unused]] int nthreads) {
+#if defined(_OPENMP)
+        omp_set_num_threads(nthreads);
+#elif defined(USE_THREAD)
+        setenv("SOLVER_NUM_THREADS", std::to_string(nthreads).c_str(), 1);
+#elif defined(USE_STDPAR)
+        static auto limit = std::optional<tbb::global_control>(); // one at a time, since TBB obeys the smallest
+        limit.reset();
+        limit.emplace(tbb::global_control::max_allowed_parallelism, nthreads);
+#endif
+    }
+
+
+
+    // Write a range like the one initial solves, scaled to cells cells, to a file that every process can read
+    std::string write_range(size_t cells) {
+        auto filename = std::format("mountainbench-{}-{}.mr", backend, cells);
+        if (rank() == 0) {
+            std::vector<value_type> r(cells), h(cells);
+            std::fill(r.begin()+cells/4, r.begin()+cells/2, 1);
+            h[0] = 1;
+            MountainRange<>(r, h).write(filename.c_str());
+        }
+        barrier();
+        return filename;
+    }
+
+    // Wall time of the fastest of several trials of run(setup()), timing only run, with every process starting each
+    // trial together
+    double best_time(auto &&setup, auto &&run, size_t ntrials=trials) {
+        auto best = std::numeric_limits<double>::infinity();
+        for (size_t trial=0; trial<ntrials; trial++) {
+            auto &&state = setup();
+            barrier();
+            auto start = std::chrono::steady_clock::now();
+            run(state);
+            barrier();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    // Print a measurement of updates cell updates, each moving bytes_per_update bytes, taking seconds
+    void report(int threads, const char *operation, size_t cells, double seconds, double updates,
+                size_t bytes_per_update) {
+        if (rank() > 0) return;
+        std::cout << std::format("{},{},{},{},{},{:.6g},{:.6g},{:.6g}", backend, ranks(), threads, operation, cells,
+                                 seconds, updates / seconds, updates * bytes_per_update / seconds / 1e9) << std::endl;
+    }
+};
+
+
+
+int main(int argc, char **argv) try {
+    // Parse arguments
+    if (argc > 2 || (argc == 2 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help"))) {
+        if (rank() == 0) {
+            std::cout << "Usage: " << argv[0] << " [max-cells]\n"
+                      << "Benchmark step, dsteepness, and solve on mountain ranges of " << min_cells << " cells, "
+                      << "then 4 times as many, and so on up to max-cells (default " << default_max_cells << "), "
+                      << "with each power-of-2 thread count up to the maximum available. Results are printed as CSV."
+                      << std::endl;
+        }
+        return argc == 2 ? 0 : 2;
+    }
+    size_t max_cells = default_max_cells;
+    if (argc == 2) std::from_chars(argv[1], argv[1]+std::strlen(argv[1]), max_cells);
+
+    // Benchmark
+    if (rank() == 0) std::cout << "backend,ranks,threads,operation,cells,seconds,cells_per_second,gb_per_second\n";
+    for (auto threads: thread_counts()) {
+        use_threads(threads);
+        for (auto cells=min_cells; cells<=max_cells; cells*=4) {
+            auto filename = write_range(cells);
+
+            // Step and dsteepness, a trial's worth of updates at a time
+            auto reps = std::max(updates_per_trial / cells, size_t{1});
+            {
+                auto m = MtnRange(filename.c_str());
+                auto same_range = [&]() -> auto & { return m; }; // https://tinyurl.com/byusc-lambda
+                auto step_time = best_time(same_range, [&](auto &range){ for (size_t i=0; i<reps; i++) range.step(dt); });
+                report(threads, "step", cells, step_time, double(reps) * cells, step_bytes);
+                auto ds_time = best_time(same_range, [&](auto &range){ for (size_t i=0; i<reps; i++) range.dsteepness(); });
+                report(threads, "dsteepness", cells, ds_time, double(reps) * cells, ds_bytes);
+            }
+
+            // Solve a freshly read range each trial
+            value_type t = 0;
+            auto solve_time = best_time([&]{ return MtnRange(filename.c_str()); },
+                                        [&](auto &range){ t = range.solve(dt); },
+                                        std::max(cells_per_solve / cells, trials));
+            report(threads, "solve", cells, solve_time, std::round(t / dt) * cells, solve_bytes);
+
+            barrier();
+            if (rank() == 0) std::remove(filename.c_str());
+        }
+    }
+    return 0;
+} catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+}
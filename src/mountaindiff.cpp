@@ -1,23 +1,136 @@
 #include <iostream>
+#include <fstream>
 #include <numeric>
+#include <functional>
+#include <string>
+#include <algorithm>
 #include <ranges>
 #include <sstream>
-#include "MountainRange.hpp"
+#include <array>
+#include <vector>
+#include <span>
+#include <memory>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "binary_io.hpp"
+#include "mapped_file.hpp"
+#include "tolerances.hpp"
 
 
 
 // This program compares two mountain ranges to determine whether they represent the same mountain range.
 // Usage: mountaindiff range1.mr range2.mr
+//
+// Only the headers are read at first, and nothing else is if they don't match. Then r and h are streamed through a
+// chunk at a time--straight from the files mapped into memory where possible--so that huge files can be compared in
+// bounded memory, and the chunks are compared by OpenMP threads.
 
 
 
+using size_type  = size_t;
+using value_type = double;
+
 // Tolerances
-const MountainRange::value_type acceptable_time_ratio         = 1.0001,
-                                acceptable_height_error_ratio = 0.000001; // TODO: should this increase with time?
+using mr::acceptable_time_ratio, mr::acceptable_height_error_ratio;
+
+// Cells compared by a thread at a time, and cells summed plainly before being added to a compensated sum
+constexpr size_type chunk_size = 1 << 20, sum_block_size = 1 << 8;
+
+
+
+// A mountain range file's header, with its body available a batch of cells at a time
+class range_file {
+    const char *filename;
+    std::ifstream s;
+    std::unique_ptr<const mr::mapped_file> map;
+    std::array<std::vector<value_type>, 2> buffers; // r and h, if not mapped
+
+public:
+    size_type ndims, cells, header_size;
+    std::vector<size_type> dims;
+    value_type t;
+
+    // Shape as a string like 24x32, for error messages
+    std::string shape() const {
+        std::string shape;
+        for (auto d: dims) shape += (shape.empty() ? "" : "x") + std::to_string(d);
+        return shape;
+    }
+
+    // Read the header, and map the file if possible
+    range_file(const char *filename): filename{filename}, s(filename, std::ios::binary) {
+        try {
+            ndims = try_read_bytes<size_type>(s);
+            if (ndims < 1 || ndims > 16) throw std::logic_error(std::string(filename) + " appears to be corrupt");
+            dims.resize(ndims);
+            try_read_bytes(s, dims.data(), ndims);
+            cells = std::accumulate(dims.begin(), dims.end(), size_type{1}, std::multiplies<>());
+            header_size = sizeof(size_type) * (1 + ndims) + sizeof(value_type);
+            t = try_read_bytes<value_type>(s);
+        } catch (const std::ios_base::failure &e) {
+            throw std::logic_error("Failed to read from " + std::string(filename));
+        }
+#ifdef MR_HAVE_MMAP
+        try {
+            map = std::make_unique<const mr::mapped_file>(filename);
+        } catch (const std::filesystem::filesystem_error &e) {} // fall back on streaming
+#endif
+    }
+
+    // Cells [first, first+n) of r (which=0) or h (which=1); the span is valid until the next read of the same array
+    std::span<const value_type> read(int which, size_type first, size_type n) {
+        auto offset = header_size + sizeof(value_type) * (which * cells + first);
+        if (map) {
+            if (map->size() < offset + sizeof(value_type) * n) {
+                throw std::logic_error(std::string(filename) + " appears to be corrupt");
+            }
+            return {reinterpret_cast<const value_type *>(map->data() + offset), n};
+        }
+        auto &buffer = buffers[which];
+        buffer.resize(n);
+        try {
+            s.seekg(offset);
+            try_read_bytes(s, buffer.data(), n);
+        } catch (const std::ios_base::failure &e) {
+            throw std::logic_error("Failed to read from " + std::string(filename));
+        }
+        return buffer;
+    }
+};
 
 
 
-int main(int argc, char **argv) {
+// A sum accumulated with Neumaier's compensation, so that summing billions of squares doesn't lose precision
+struct compensated_sum {
+    value_type sum = 0, compensation = 0;
+
+    compensated_sum &operator+=(value_type x) {
+        auto total = sum + x;
+        compensation += std::abs(sum) >= std::abs(x) ? (sum - total) + x : (x - total) + sum;
+        sum = total;
+        return *this;
+    }
+
+    compensated_sum &operator+=(const compensated_sum &other) {
+        *this += other.sum;
+        *this += other.compensation;
+        return *this;
+    }
+
+    value_type value() const { return sum + compensation; }
+};
+
+// What comparing a chunk finds
+struct chunk_result {
+    bool r_equal = true;
+    compensated_sum height_squares, difference_squares;
+};
+
+
+
+int main(int argc, char **argv) try {
     // Set the return code to 1 and print a message if condition is false
     int ret = 0;
     auto ensure = [&](bool correct, auto &&...message){ // https://tinyurl.com/byusc-parpack
@@ -47,11 +160,10 @@ int main(int argc, char **argv) {
     auto filename1 = argv[1];
     auto filename2 = argv[2];
 
-    // Read in both hotplates
-    const auto m1 = MountainRange(filename1);
-    const auto m2 = MountainRange(filename2);
-    const auto &r1 = m1.uplift_rate(), &r2 = m2.uplift_rate(), &h1 = m1.height(), &h2 = m2.height();
-    auto t1 = m1.sim_time(), t2 = m2.sim_time();
+    // Read in both headers
+    auto m1 = range_file(filename1);
+    auto m2 = range_file(filename2);
+    auto t1 = m1.t, t2 = m2.t;
 
     // Make sure that times are about the same
     auto time_ratio = t1 > 0 || t2 > 0 ? t1 / t2 : 1;
@@ -59,26 +171,64 @@ int main(int argc, char **argv) {
            "Simulation times (", t1, " and ", t2, ") are not within tolerance");
 
     // Make sure sizes are the same
-    ensure(h1.size() == h2.size(), "Sizes (", h1.size(), " and ", h2.size(), ") are not the same");
+    ensure(m1.ndims == m2.ndims, "Dimensions (", m1.ndims, " and ", m2.ndims, ") are not the same");
+    ensure(m1.ndims != m2.ndims || m1.dims == m2.dims,
+           "Sizes (", m1.shape(), " and ", m2.shape(), ") are not the same");
+
+    // No point in reading the rest if the headers don't match
+    if (ret != 0) return ret;
+
+    // Compare r and h a batch of chunks at a time, a chunk per thread
+    size_type nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    auto cells = m1.cells;
+    auto nchunks = (cells + chunk_size - 1) / chunk_size;
+    std::vector<chunk_result> results(nchunks);
+    for (size_type batch_first=0; batch_first<cells; batch_first+=nthreads*chunk_size) {
+        auto batch_size = std::min(nthreads*chunk_size, cells-batch_first);
+        auto r1 = m1.read(0, batch_first, batch_size), r2 = m2.read(0, batch_first, batch_size);
+        auto h1 = m1.read(1, batch_first, batch_size), h2 = m2.read(1, batch_first, batch_size);
+        #pragma omp parallel for schedule(static)
+        for (size_type c=0; c<nthreads; c++) {
+            auto first = c * chunk_size, last = std::min(first+chunk_size, batch_size);
+            if (first >= last) continue;
+            auto &result = results[(batch_first + first) / chunk_size];
+            result.r_equal = std::equal(r1.begin()+first, r1.begin()+last, r2.begin()+first);
+            for (auto block_first=first; block_first<last; block_first+=sum_block_size) {
+                value_type height_squares = 0, difference_squares = 0;
+                for (auto i=block_first; i<std::min(block_first+sum_block_size, last); i++) {
+                    height_squares += h1[i] * h1[i];
+                    difference_squares += (h1[i] - h2[i]) * (h1[i] - h2[i]);
+                }
+                result.height_squares += height_squares;
+                result.difference_squares += difference_squares;
+            }
+        }
+    }
+
+    // Combine chunks in order, so the result doesn't depend on thread count
+    chunk_result total;
+    for (const auto &result: results) {
+        total.r_equal = total.r_equal && result.r_equal;
+        total.height_squares += result.height_squares;
+        total.difference_squares += result.difference_squares;
+    }
 
     // Make sure that r are equal
-    ensure(m1.uplift_rate() == m2.uplift_rate(), "Growth rates are not equal");
+    ensure(total.r_equal, "Growth rates are not equal");
 
     // Make sure that h are about the same
-    if (h1.size() == h2.size()) { // no point of comparison if lengths are different
-        auto inds = std::views::iota(0ul, h1.size());
-        auto m1_height_rms = sqrt(std::transform_reduce(h1.begin(), h1.end(), decltype(m1)::value_type{}, std::plus<>(),
-                                                        [](auto h){ return h * h; } // https://tinyurl.com/byusc-lambda
-                                 ) / h1.size());
-        auto height_difference_rms = sqrt(std::transform_reduce(inds.begin(), inds.end(), decltype(m1)::value_type{},
-                                                                std::plus<>(),
-                                                                [&](auto i){ return pow(h1[i] - h2[i], 2); }
-                                         ) / h1.size());
-        auto height_error_ratio = height_difference_rms ? height_difference_rms / m1_height_rms : 0;
-        ensure(height_error_ratio < acceptable_height_error_ratio,
-               "Heights are not within tolerance (height error ratio is ", height_error_ratio, ")");
-    }
+    auto m1_height_rms = std::sqrt(total.height_squares.value() / cells);
+    auto height_difference_rms = std::sqrt(total.difference_squares.value() / cells);
+    auto height_error_ratio = height_difference_rms ? height_difference_rms / m1_height_rms : 0;
+    ensure(height_error_ratio < acceptable_height_error_ratio,
+           "Heights are not within tolerance (height error ratio is ", height_error_ratio, ")");
 
     // ret will have been set to 1 if any ensure failed, otherwise it's 0
     return ret;
+} catch (const std::logic_error &e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
 }
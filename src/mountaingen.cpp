@@ -0,0 +1,175 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <future>
+#include <numbers>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "binary_io.hpp"
+
+
+
+// This program writes a synthetic mountain range of any size straight to a file, without ever holding all of it in
+// memory. Cells are generated a batch at a time by OpenMP threads while the previous batch is being written, so memory
+// use is bounded by the batch size no matter how big the range is. Every cell's value depends only on its index, the
+// range's size, and the seed, so the output is the same no matter how many threads generate it.
+// Usage: mountaingen profile cells outfile [seed]
+
+
+
+namespace {
+    using size_type  = size_t;
+    using value_type = double;
+
+    // Cells each thread generates at a time; two batches of this many per thread are in memory at once
+    constexpr size_type chunk_size = 1 << 20;
+
+
+
+    // A pseudorandom number in [-1, 1) determined by its arguments alone (SplitMix64's finalizer on their combination)
+    value_type hash_unit(uint64_t seed, uint64_t octave, uint64_t k) {
+        uint64_t x = seed * 0x9e3779b97f4a7c15 + octave * 0xbf58476d1ce4e5b9 + k * 0x94d049bb133111eb;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        x ^= x >> 31;
+        return static_cast<value_type>(x >> 11) * 0x1p-52 - 1;
+    }
+
+    // Smooth noise of amplitude at most 2 at cell i of n: octaves of values at evenly spaced points, interpolated
+    // smoothly between, each octave with points twice as close together and half the amplitude of the last
+    value_type value_noise(size_type i, size_type n, uint64_t seed) {
+        value_type noise = 0, amplitude = 1;
+        for (uint64_t octave=0; octave<8; octave++, amplitude/=2) {
+            auto period = std::max(n >> (octave + 4), size_type{1});
+            auto k = i / period;
+            auto f = static_cast<value_type>(i % period) / period;
+            f = f * f * (3 - 2 * f);
+            auto a = hash_unit(seed, octave, k), b = hash_unit(seed, octave, k+1);
+            noise += amplitude * (a + (b - a) * f);
+        }
+        return noise;
+    }
+
+    // A chirp from start_freq to end_freq over the whole range, as in Mountains.jl's generatesamples.jl
+    value_type chirp(size_type i, size_type n, value_type start_freq, value_type end_freq) {
+        auto t = n > 1 ? static_cast<value_type>(i) / (n - 1) : 0;
+        return std::sin(2 * std::numbers::pi * t * (start_freq + t * (end_freq - start_freq) / 2));
+    }
+
+    // A Gaussian hump of height 1 centered on the range, as in generatesamples.jl
+    value_type gaussian_hump(size_type i, size_type n) {
+        auto pos = (n + 1) / 2.0, sigma = n / 8.0, x = i + 1 - pos;
+        return std::exp(-x * x / 2 / (sigma * sigma));
+    }
+
+
+
+    // Uplift rate and initial height profiles
+    struct profile {
+        const char *name;
+        const char *description;
+        value_type (*r)(size_type i, size_type n, uint64_t seed);
+        value_type (*h)(size_type i, size_type n, uint64_t seed);
+    };
+
+    constexpr std::array profiles{
+        profile{"plateau", "uplift of 1 on the second quarter of the range, flat ground except the first cell (like "
+                           "initial)",
+                [](size_type i, size_type n, uint64_t){ return value_type(i >= n/4 && i < n/2); },
+                [](size_type i, size_type, uint64_t){ return value_type(i == 0); }},
+        profile{"chirp", "uplift chirping from 0 to 15 cycles, ground sloping from -0.1 to 0.1 (like 1d-tiny-in.mr)",
+                [](size_type i, size_type n, uint64_t){ return chirp(i, n, 0, 15); },
+                [](size_type i, size_type n, uint64_t){ return n > 1 ? -0.1 + 0.2 * i / (n - 1) : 0; }},
+        profile{"hump", "a chirp from 0 to 100 cycles on a Gaussian hump, with ground following the chirp (like "
+                        "1d-small-in.mr)",
+                [](size_type i, size_type n, uint64_t){ return 25 * chirp(i, n, 0, 100) + 200 * gaussian_hump(i, n); },
+                [](size_type i, size_type n, uint64_t){ return 0.01 * chirp(i, n, 0, 100); }},
+        profile{"noise", "smooth random uplift and ground, different for each seed",
+                [](size_type i, size_type n, uint64_t seed){ return value_noise(i, n, seed) / 2; },
+                [](size_type i, size_type n, uint64_t seed){ return value_noise(i, n, ~seed) / 200; }},
+    }; // https://tinyurl.com/byusc-lambda
+
+
+
+    // Stream values of f for cells [0, n) to s, generating each batch in parallel while the last one is written
+    void stream_cells(std::ostream &s, size_type n, auto f) {
+        size_type nthreads = 1;
+#ifdef _OPENMP
+        nthreads = omp_get_max_threads();
+#endif
+        auto batch_size = nthreads * chunk_size;
+        std::array<std::vector<value_type>, 2> batches;
+        std::future<void> writer;
+        for (size_type first=0, b=0; first<n; first+=batch_size, b^=1) {
+            auto &batch = batches[b];
+            batch.resize(std::min(batch_size, n-first));
+            #pragma omp parallel for schedule(static)
+            for (size_type c=0; c<nthreads; c++) {
+                auto chunk_first = c * chunk_size, chunk_last = std::min(chunk_first+chunk_size, batch.size());
+                for (auto i=chunk_first; i<chunk_last; i++) batch[i] = f(first + i);
+            }
+            if (writer.valid()) writer.get();
+            writer = std::async(std::launch::async, [&s, &batch]{ try_write_bytes(s, batch.data(), batch.size()); });
+        }
+        if (writer.valid()) writer.get();
+    }
+}
+
+
+
+int main(int argc, char **argv) {
+    // Parse
+    const auto help_message = [&]{
+        std::stringstream s;
+        s << "Usage: " << argv[0] << " profile cells outfile [seed]" << std::endl
+          << "Write a mountain range of the given number of cells to outfile, with uplift rate and initial height "
+          << "following one of these profiles:" << std::endl;
+        for (const auto &p: profiles) s << "  " << p.name << ": " << p.description << std::endl;
+        s << "The seed (default 0) only affects the noise profile; the same arguments always produce the same file. "
+          << "Set OMP_NUM_THREADS to control how many threads generate cells.";
+        return s.str();
+    }(); // https://tinyurl.com/byusc-lambdai
+    if (argc > 1 && (std::string(argv[1]) == std::string("-h") || std::string(argv[1]) == std::string("--help"))) {
+        std::cout << help_message << std::endl;
+        return 0;
+    }
+    if (argc != 4 && argc != 5) {
+        std::cerr << "Three or four arguments must be supplied" << std::endl << help_message << std::endl;
+        return 2;
+    }
+    auto p = std::ranges::find_if(profiles, [&](const auto &p){ return std::string(p.name) == argv[1]; });
+    size_type cells = 0;
+    uint64_t seed = 0;
+    auto cells_parsed = std::from_chars(argv[2], argv[2]+std::strlen(argv[2]), cells);
+    auto seed_parsed = argc == 5 ? std::from_chars(argv[4], argv[4]+std::strlen(argv[4]), seed) : cells_parsed;
+    if (p == profiles.end() || cells_parsed.ec != std::errc() || seed_parsed.ec != std::errc() || cells < 3) {
+        std::cerr << "Invalid profile, cell count (which must be at least 3), or seed" << std::endl << help_message
+                  << std::endl;
+        return 2;
+    }
+    auto outfile = argv[3];
+
+    // Write the header, then r, then h
+    try {
+        auto f = std::ofstream(outfile, std::ios::binary);
+        size_type ndims = 1;
+        value_type t = 0;
+        try_write_bytes(f, &ndims, &cells, &t);
+        stream_cells(f, cells, [&](auto i){ return p->r(i, cells, seed); }); // https://tinyurl.com/byusc-lambda
+        stream_cells(f, cells, [&](auto i){ return p->h(i, cells, seed); });
+    } catch (const std::ios_base::failure &e) {
+        std::cerr << "Failed to write to " << outfile << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,24 +1,58 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <syncstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
 #ifdef MPI_VERSION
 #include <mpl/mpl.hpp>
 #endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if __has_include(<sys/inotify.h>)
+#define MR_HAVE_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 
 
-// Compile with -DUSE_OPENMP for OpenMP version, -DUSE_THREAD for pthread version, etc.
+// Compile with -DUSE_OPENMP for OpenMP version, -DUSE_THREAD for pthread version, etc.; -DUSE_MPI with OpenMP enabled
+// gives the hybrid version, -DUSE_FLOAT gives the OpenMP version with ranges stored in single precision,
+// -DUSE_STDPAR gives the GPU version built for CPUs by a compiler other than nvc++, and -DUSE_ANY_BACKEND gives a
+// version that picks between the OpenMP, single precision, and pthread versions at runtime
 #if defined(USE_OPENMP)
 #include "MountainRange.hpp"
-using MtnRange = MountainRange;
+using MtnRange = MountainRange<>;
+#elif defined(USE_FLOAT)
+#include "MountainRange.hpp"
+using MtnRange = MountainRange<float>;
 #elif defined(USE_THREAD)
 #include "MountainRangeThreaded.hpp"
 using MtnRange = MountainRangeThreaded;
-#elif defined(USE_GPU)
+#elif defined(USE_GPU) || defined(USE_STDPAR)
 #include "MountainRangeGPU.hpp"
 using MtnRange = MountainRangeGPU;
 #elif defined(USE_MPI)
 #include "MountainRangeMPI.hpp"
 using MtnRange = MountainRangeMPI;
+#elif defined(USE_ANY_BACKEND)
+#include "MountainRange.hpp"
+#include "MountainRangeThreaded.hpp"
 #endif
+#include "MountainRangeEnsemble.hpp"
+#include "tolerances.hpp"
 
 
 
@@ -42,14 +76,465 @@ namespace {
 
 
 
-// Create a mountain range from an infile (argv[1]), solve it, and write it to an outfile (argv[2]).
-int main(int argc, char **argv) {
+// Each implementation's solve loop is compiled separately, so that steps inline all the way down to the cells; the
+// implementation is chosen once, up front, by calling the rest of the program with it as a template argument
+namespace {
+    // Return f.template operator()<R>(), where R is the implementation this was compiled for, or with -DUSE_ANY_BACKEND,
+    // the one named by the environment variable SOLVER_BACKEND
+    decltype(auto) with_backend(auto &&f) {
+#ifdef USE_ANY_BACKEND
+        auto str = std::getenv("SOLVER_BACKEND");
+        auto backend = std::string(str == nullptr ? "openmp" : str);
+        if (backend == "openmp") return f.template operator()<MountainRange<>>();
+        if (backend == "float")  return f.template operator()<MountainRange<float>>();
+        if (backend == "thread") return f.template operator()<MountainRangeThreaded>();
+        throw std::logic_error("SOLVER_BACKEND must be openmp, float, or thread, not " + backend);
+#else
+        return f.template operator()<MtnRange>();
+#endif
+    }
+
+    // Whether implementation R stores ranges at lower precision than it calculates time and ds in
+    template <class R>
+    constexpr bool lower_precision = !std::is_same_v<typename R::storage_type, typename R::value_type>;
+};
+
+
+
+// Batch mode solves every range listed in a manifest in one process, so that sweeps over many ranges don't pay for
+// process startup, thread pool creation, or MPI initialization each time. Ranges small enough to share memory with one
+// per worker are each solved whole by a single thread, with workers (and MPI processes) taking turns grabbing the next
+// one; ranges of the same size are grouped and solved in lockstep by a MountainRangeEnsemble. Larger ranges are then
+// solved one at a time by the full parallel implementation.
+namespace {
+    // A range to solve
+    struct batch_job {
+        std::string infile, outfile;
+        size_t cells;
+    };
+
+    // Memory each cell might need while solving: r, h, g, their temporal blocking counterparts, and a checkpoint copy
+    template <class R>
+    constexpr size_t batch_bytes_per_cell = 6 * sizeof(typename R::storage_type);
+
+    // Largest ranges worth solving as an ensemble; bigger ones are solved faster alone, since a lone range's r, h, and
+    // g stay in L1 cache while an ensemble's spill out of it
+    constexpr size_t batch_ensemble_max_cells = 256;
+
+    // Read a setting from the environment, or return default_value if it's not set
+    template <class T>
+    T batch_setting(const char *name, T default_value) {
+        auto str = std::getenv(name);
+        if (str != nullptr) std::from_chars(str, str+std::strlen(str), default_value);
+        return default_value;
+    }
+
+    // Number of cells in the range in infile, or 0 if its header can't be read
+    size_t range_size(const std::string &infile) {
+        try {
+            auto s = std::ifstream(infile);
+            auto ndims = try_read_bytes<size_t>(s);
+            size_t cells = 1;
+            for (size_t a=0; a<ndims && a<16; a++) cells *= try_read_bytes<size_t>(s);
+            return cells;
+        } catch (const std::ios_base::failure &e) {
+            return 0;
+        }
+    }
+
+    // Solve a range with implementation R, reporting failure rather than throwing
+    template <class R>
+    bool solve_job(const batch_job &job) {
+        try {
+            auto m = R(job.infile.c_str());
+            m.solve();
+            m.write(job.outfile.c_str());
+            return true;
+        } catch (const std::exception &e) {
+            std::osyncstream(std::cerr) << e.what() << "; skipping " << job.infile << std::endl;
+            return false;
+        }
+    }
+
+    // Solve a group of ranges of the same size as an ensemble, falling back on solving them one by one if that fails.
+    // Ensembles are stored in double precision, so lower precision implementations always solve them one by one, lest
+    // a range's answer depend on what else is in the manifest.
+    template <class R>
+    size_t solve_group(const std::vector<batch_job> &group) {
+        if (group.size() > 1 && !lower_precision<R>) {
+            try {
+                auto infiles = std::vector<std::string>();
+                for (const auto &job: group) infiles.push_back(job.infile);
+                auto ensemble = MountainRangeEnsemble(infiles);
+                ensemble.solve();
+                for (size_t i=0; i<group.size(); i++) ensemble.write(i, group[i].outfile.c_str());
+                return 0;
+            } catch (const std::exception &e) {} // errors are reported below
+        }
+        size_t failures = 0;
+        for (const auto &job: group) failures += !solve_job<MountainRange<typename R::storage_type>>(job);
+        return failures;
+    }
+
+    // Solve every range in manifest, which lists an infile and outfile on each line ('#' starts a comment line),
+    // returning the number of ranges this process failed to solve
+    template <class R>
+    size_t solve_batch(const char *manifest) {
+        if (std::getenv("INTVL") != nullptr) {
+            throw std::logic_error("Checkpointing (INTVL) can't be used in batch mode, since every range would write "
+                                   "the same checkpoint files");
+        }
+
+        // Settings
+#if defined(_OPENMP)
+        size_t default_workers = omp_get_max_threads();
+#elif defined(MPI_VERSION)
+        size_t default_workers = 1;
+#else
+        size_t default_workers = std::max(std::thread::hardware_concurrency(), 1u);
+#endif
+        auto workers = std::max(batch_setting("SOLVER_BATCH_WORKERS", default_workers), size_t{1});
+        auto budget = size_t(batch_setting("SOLVER_BATCH_MEMORY", 1024.0) * (1 << 20));
+        auto ensemble_width = std::max(batch_setting("SOLVER_BATCH_ENSEMBLE", size_t{64}), size_t{1});
+
+        // Read the manifest, sorting ranges by whether they fit in a worker's share of the memory budget
+        std::vector<batch_job> whole, split;
+        auto f = std::ifstream(manifest);
+        if (!f) throw std::logic_error("Failed to read from " + std::string(manifest));
+        for (std::string line; std::getline(f, line);) {
+            auto words = std::istringstream(line);
+            batch_job job;
+            if (!(words >> job.infile) || job.infile.starts_with('#')) continue;
+            if (!(words >> job.outfile)) throw std::logic_error("Manifest line \"" + line + "\" has no outfile");
+            job.cells = range_size(job.infile);
+            (job.cells * batch_bytes_per_cell<R> <= budget / workers ? whole : split).push_back(job);
+        }
+
+        // Group small ranges of the same size, as many to a group as fit in a worker's share of the budget
+        std::ranges::stable_sort(whole, {}, &batch_job::cells);
+        std::vector<std::vector<batch_job>> groups;
+        for (const auto &job: whole) {
+            auto width = std::clamp(budget / workers / std::max(job.cells * batch_bytes_per_cell<R>, size_t{1}),
+                                    size_t{1}, job.cells <= batch_ensemble_max_cells ? ensemble_width : 1);
+            if (groups.empty() || groups.back().size() >= width || groups.back().back().cells != job.cells) {
+                groups.emplace_back();
+            }
+            groups.back().push_back(job);
+        }
+#ifdef MPI_VERSION
+        auto &comm_world = mpl::environment::comm_world();
+        size_t first_group = comm_world.rank(), group_stride = comm_world.size();
+        comm_world.barrier();
+#else
+        size_t first_group = 0, group_stride = 1;
+#endif
+        auto start_time = std::chrono::steady_clock::now();
+
+        // Solve small ranges whole, one group per worker thread at a time, with the serial base implementation
+        std::atomic<size_t> next_group = first_group, failures = 0;
+        {
+            std::vector<std::jthread> pool;
+            for (size_t w=0; w<workers; w++) {
+                pool.emplace_back([&]{
+#ifdef _OPENMP
+                    omp_set_num_threads(1); // don't nest parallelism within a worker
+#endif
+                    for (auto i=next_group.fetch_add(group_stride); i<groups.size();
+                             i=next_group.fetch_add(group_stride)) {
+                        failures += solve_group<R>(groups[i]);
+                    }
+                }); // https://tinyurl.com/byusc-lambda
+            }
+        }
+
+        // Solve large ranges one at a time with every thread (and process)
+        for (const auto &job: split) {
+            if (job.cells * batch_bytes_per_cell<R> > budget) {
+                print<to::stderr>(job.infile, " alone might exceed the memory budget of SOLVER_BATCH_MEMORY");
+            }
+            failures += !solve_job<R>(job);
+        }
+
+        // Report throughput
+        size_t total_failures = failures;
+#ifdef MPI_VERSION
+        comm_world.allreduce(std::plus<>(), size_t(failures), total_failures);
+#endif
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        auto solved = whole.size() + split.size() - total_failures;
+        print("Solved ", solved, " of ", whole.size() + split.size(), " mountain ranges (", split.size(),
+              " split across all threads, the rest in ", groups.size(), " groups) in ", seconds, " s: ",
+              solved / seconds, " ranges/second");
+        return failures;
+    }
+};
+
+
+
+// Serve mode keeps running, solving the jobs dropped into a spool directory as they arrive, so that a pipeline of many
+// small solves pays for process startup once rather than per job. Each job is a file NAME.job listing an infile and
+// outfile on each line like a batch manifest; it should be written under another name and renamed into place so that
+// it's never read half written. The solver claims it by renaming it NAME.running, appends a line to NAME.status as
+// each range starts and finishes (with its timing), ends NAME.status with a line starting with "done", and removes
+// NAME.running. Creating a file named stop in the spool directory shuts the solver down once the current job is done.
+// Ranges solved recently are kept, keyed by shape, so that the next range of the same shape is read into the memory
+// (and for MountainRangeThreaded, the threads) they already have rather than allocating and first touching afresh.
+namespace {
+    // A range kept for reuse, and when it was last used
+    template <class R>
+    struct warm_range {
+        std::unique_ptr<R> range;
+        size_t last_used;
+    };
+
+    // Read the range in infile into a kept range of the same shape if there is one, or into a new one that's kept in
+    // place of the least recently used if there are already max_kept; returns the range and whether it was reused
+    template <class R>
+    std::pair<R &, bool> warm_range_for(std::vector<warm_range<R>> &kept, size_t max_kept, size_t job_number,
+                                        const std::string &infile) {
+        for (auto &w: kept) {
+            if (w.range->reload(infile.c_str())) {
+                w.last_used = job_number;
+                return {*w.range, true};
+            }
+        }
+        auto fresh = std::make_unique<R>(infile.c_str());
+        if (kept.size() < std::max(max_kept, size_t{1})) {
+            kept.push_back({std::move(fresh), job_number});
+            return {*kept.back().range, false};
+        }
+        auto &oldest = *std::ranges::min_element(kept, {}, &warm_range<R>::last_used);
+        oldest = {std::move(fresh), job_number};
+        return {*oldest.range, false};
+    }
+
+    // Blocks until something may have arrived in the spool directory: until a file is moved or created there, or where
+    // inotify isn't available, for poll_interval. The watch is set up before the directory is first scanned, so a job
+    // that arrives between a scan and the next wait still wakes it.
+    class spool_watch {
+        int fd = -1;
+        std::chrono::milliseconds poll_interval;
+
+    public:
+        spool_watch(const std::filesystem::path &spool, std::chrono::milliseconds poll_interval):
+                poll_interval{poll_interval} {
+#ifdef MR_HAVE_INOTIFY
+            fd = inotify_init1(IN_CLOEXEC);
+            if (fd >= 0 && inotify_add_watch(fd, spool.c_str(), IN_MOVED_TO | IN_CREATE) < 0) {
+                close(fd);
+                fd = -1;
+            }
+#endif
+        }
+
+        spool_watch(const spool_watch &) = delete;
+        spool_watch &operator=(const spool_watch &) = delete;
+
+        ~spool_watch() {
+#ifdef MR_HAVE_INOTIFY
+            if (fd >= 0) close(fd);
+#endif
+        }
+
+        void wait() {
+#ifdef MR_HAVE_INOTIFY
+            if (fd >= 0) {
+                alignas(inotify_event) char events[4096];
+                if (read(fd, events, sizeof(events)) > 0) return; // which file doesn't matter; the caller rescans
+            }
+#endif
+            std::this_thread::sleep_for(poll_interval);
+        }
+    };
+
+    // Solve every range in the job file at path, streaming status to its status file; returns the number of ranges
+    // that couldn't be solved
+    template <class R>
+    size_t serve_job(const std::filesystem::path &path, std::vector<warm_range<R>> &kept, size_t max_kept,
+                     size_t &ranges_served) {
+        auto status = std::ofstream(std::filesystem::path(path).replace_extension(".status"));
+        auto report = [&](auto && ...args){ (status << ... << args) << std::endl; }; // flushed, so clients see each line
+        auto job_start = std::chrono::steady_clock::now();
+        auto seconds_since = [](auto start){
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }; // https://tinyurl.com/byusc-lambda
+        size_t ranges = 0, failures = 0;
+        auto f = std::ifstream(path);
+        for (std::string line; std::getline(f, line);) {
+            auto words = std::istringstream(line);
+            std::string infile, outfile;
+            if (!(words >> infile) || infile.starts_with('#')) continue;
+            ranges++;
+            auto job_number = ranges_served++;
+            try {
+                if (!(words >> outfile)) throw std::logic_error("Job line \"" + line + "\" has no outfile");
+                report("solving ", infile);
+                auto start = std::chrono::steady_clock::now();
+                auto [m, reused] = warm_range_for(kept, max_kept, job_number, infile);
+                auto read_seconds = seconds_since(start);
+                start = std::chrono::steady_clock::now();
+                m.solve();
+                auto solve_seconds = seconds_since(start);
+                start = std::chrono::steady_clock::now();
+                m.write(outfile.c_str());
+                report("solved ", infile, " to ", outfile, "; simulation time ", m.sim_time(), "; read ",
+                       read_seconds, " s (", reused ? "reused" : "new", " buffers), solve ", solve_seconds,
+                       " s, write ", seconds_since(start), " s");
+            } catch (const std::exception &e) {
+                failures++;
+                report("failed ", infile, ": ", e.what());
+            }
+        }
+        report("done: solved ", ranges - failures, " of ", ranges, " ranges in ", seconds_since(job_start), " s");
+        return failures;
+    }
+
+    // Solve jobs from spooldir as they arrive until a stop file appears, returning the number of ranges that couldn't
+    // be solved
+    template <class R>
+    size_t serve(const char *spooldir) {
+#ifdef MPI_VERSION
+        throw std::logic_error("Serve mode can't be used with MPI, since each process only holds part of each range");
+#endif
+        if (std::getenv("INTVL") != nullptr) {
+            throw std::logic_error("Checkpointing (INTVL) can't be used in serve mode, since every range would write "
+                                   "the same checkpoint files");
+        }
+        auto spool = std::filesystem::path(spooldir);
+        if (!std::filesystem::is_directory(spool)) throw std::logic_error(spool.string() + " is not a directory");
+        auto poll_interval = std::chrono::milliseconds(batch_setting("SOLVER_SERVE_POLL_MS", 50));
+        auto max_kept = batch_setting("SOLVER_SERVE_KEEP", size_t{4});
+        auto watch = spool_watch(spool, poll_interval);
+        print("Serving jobs from ", spool.string());
+
+        // Claim and solve jobs in name order, waiting for more when there are none
+        std::vector<warm_range<R>> kept;
+        size_t ranges_served = 0, failures = 0;
+        while (!std::filesystem::exists(spool / "stop")) {
+            std::vector<std::filesystem::path> jobs;
+            for (const auto &entry: std::filesystem::directory_iterator(spool)) {
+                if (entry.path().extension() == ".job") jobs.push_back(entry.path());
+            }
+            std::ranges::sort(jobs);
+            for (const auto &job: jobs) {
+                auto running = std::filesystem::path(job).replace_extension(".running");
+                auto error = std::error_code();
+                std::filesystem::rename(job, running, error);
+                if (error) continue; // another solver serving the same directory got it first
+                failures += serve_job<R>(running, kept, max_kept, ranges_served);
+                std::filesystem::remove(running);
+            }
+            if (jobs.empty()) watch.wait();
+        }
+        std::filesystem::remove(spool / "stop");
+        print("Stopped after solving ", ranges_served - failures, " of ", ranges_served, " ranges");
+        return failures;
+    }
+};
+
+
+
+// Validation mode solves a range stored at lower precision in double precision too, and reports how far the lower
+// precision solve drifted from it by the same measures and tolerances as mountaindiff
+namespace {
+    // Whether R stores ranges at lower precision and the environment variable SOLVER_VALIDATE_PRECISION is set to 1
+    template <class R>
+    bool precision_validation_requested() {
+        auto str = std::getenv("SOLVER_VALIDATE_PRECISION");
+        return lower_precision<R> && str != nullptr && std::string(str) == "1";
+    }
+
+    // Solve the range in startfile in double precision, then print how far m, already solved from startfile, is from
+    // that solution, returning whether it's within mountaindiff's tolerances
+    template <class R>
+    bool validate_precision(const R &m, const std::string &startfile) {
+        auto reference = MountainRange<>(startfile.c_str());
+        reference.solve();
+        auto t1 = reference.sim_time(), t2 = m.sim_time();
+        auto time_ratio = t1 > 0 || t2 > 0 ? t1 / t2 : 1;
+        double height_squares = 0, difference_squares = 0;
+        for (size_t i=0; i<m.size(); i++) {
+            double expected = reference.height()[i], actual = m.height()[i];
+            height_squares += expected * expected;
+            difference_squares += (expected - actual) * (expected - actual);
+        }
+        auto height_error_ratio = difference_squares > 0 ? std::sqrt(difference_squares / height_squares) : 0;
+        auto within = time_ratio < mr::acceptable_time_ratio && time_ratio > 1/mr::acceptable_time_ratio &&
+                      height_error_ratio < mr::acceptable_height_error_ratio;
+        print("Validation against double precision: simulation time ", t2, " (", t1, " in double precision, ratio ",
+              time_ratio, "), height error ratio ", height_error_ratio, "; ", within ? "within" : "outside",
+              " mountaindiff's tolerances (time ratio within ", mr::acceptable_time_ratio, ", height error ratio below ",
+              mr::acceptable_height_error_ratio, ")");
+        return within;
+    }
+};
+
+
+
+// Comparison mode solves a range that was solved with the adaptive integrator again with fixed steps, and reports how
+// many steps and how much wall time each integrator took
+namespace {
+    // Whether the environment variable SOLVER_COMPARE_EULER is set to 1
+    bool euler_comparison_requested() {
+        auto str = std::getenv("SOLVER_COMPARE_EULER");
+        return str != nullptr && std::string(str) == "1";
+    }
+
+    // Solve the range in startfile with fixed steps, then print how it compares to m, already solved adaptively from
+    // startfile in adaptive_seconds
+    template <class R>
+    void compare_to_euler(const R &m, const std::string &startfile, double adaptive_seconds) {
+        auto reference = R(startfile.c_str());
+        auto t0 = reference.sim_time();
+        auto start_time = std::chrono::steady_clock::now();
+        reference.solve_euler();
+        auto euler_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        auto dt = R::default_time_step();
+        auto euler_steps = std::llround((reference.sim_time() - t0) / dt);
+        print("Comparison to Euler integration: ", m.accepted_steps(), " adaptive steps (", m.rejected_steps(),
+              " rejected) in ", adaptive_seconds, " s to simulation time ", m.sim_time(), "; ", euler_steps,
+              " steps of ", dt, " in ", euler_seconds, " s to simulation time ", reference.sim_time());
+    }
+};
+
+
+
+// Create a mountain range from an infile (argv[1]) with implementation R, solve it, and write it to an outfile (argv[2])
+template <class R>
+int mountainsolve(int argc, char **argv) {
     // Function to print a help message
     auto help = [=](){
-        print("Usage: ", argv[0], " infile outfile");
+        print("Usage: ", argv[0], " [--restart] infile outfile");
         print("Read a mountain range from infile, solve it, and write it to outfile.");
-#ifdef USE_THREAD
-        print(MtnRange::help_message);
+        print("With --restart, resume from the newest valid checkpoint of infile in the current directory instead, if "
+              "there is one.");
+        print(R::help_message);
+#ifdef USE_ANY_BACKEND
+        print("Set the environment variable SOLVER_BACKEND to openmp (the default), float (OpenMP, storing ranges in "
+              "single precision), or thread (pthreads) to choose the implementation to solve with.");
+#endif
+        if (lower_precision<R>) {
+            print("This build stores mountain ranges in single precision. Set the environment variable "
+                  "SOLVER_VALIDATE_PRECISION to 1 to also solve in double precision and report how far the solution "
+                  "drifted, returning 1 if it's outside mountaindiff's tolerances.");
+        }
+        print("With SOLVER_INTEGRATOR=adaptive, set the environment variable SOLVER_COMPARE_EULER to 1 to also solve "
+              "with the default fixed steps and report the step count and wall time of each integrator.");
+        print("`", argv[0], " --batch manifest` instead solves every infile and outfile pair listed one per line in "
+              "manifest.");
+        print("In batch mode, set the environment variable SOLVER_BATCH_WORKERS to the number of ranges to solve at "
+              "once (default one per core) and SOLVER_BATCH_MEMORY to the memory budget in MiB (default 1024); ranges "
+              "too big to solve at once within the budget are split across all threads instead. Small ranges of the same "
+              "size are solved in lockstep up to SOLVER_BATCH_ENSEMBLE (default 64) at a time.");
+        print("`", argv[0], " --serve spooldir` instead keeps running, solving each job file NAME.job dropped into "
+              "spooldir (listing ranges like a batch manifest) and writing its progress and timing to NAME.status, "
+              "until a file named stop is created there.");
+        print("In serve mode, set the environment variable SOLVER_SERVE_KEEP to the number of differently shaped ranges "
+              "whose memory to keep for reuse (default 4) and SOLVER_SERVE_POLL_MS to how often to look for new jobs "
+              "in milliseconds where the spool directory can't be watched for them (default 50).");
+#ifdef MR_PROFILE
+        print("This build prints a timing profile of each phase of solving when done; set the environment variable "
+              "SOLVER_PROFILE_JSON to a filename to also write it there as JSON.");
 #endif
         print("`", argv[0], " --help` prints this message.");
     }; // https://tinyurl.com/byusc-lambda
@@ -61,32 +546,78 @@ int main(int argc, char **argv) {
         help();
         return 0;
     }
-    if (argc != 3) {
-        print<to::stderr>("Exactly two arguments must be supplied.");
+    bool restart = argc > 1 && std::string(argv[1]) == std::string("--restart");
+    bool batch = argc > 1 && std::string(argv[1]) == std::string("--batch");
+    bool serving = argc > 1 && std::string(argv[1]) == std::string("--serve");
+    if (argc != 3 + restart) {
+        print<to::stderr>(batch   ? "Exactly one manifest must be supplied."
+                        : serving ? "Exactly one spool directory must be supplied."
+                                  : "Exactly two file arguments must be supplied.");
         help();
         return 2;
     }
-    auto infile = argv[1];
-    auto outfile = argv[2];
+    auto infile = argv[1 + restart];
+    auto outfile = argv[2 + restart];
 
 
 
-    // Run
-    try {
-        // Read from infile
-        auto m = MtnRange(infile);
-        print("Successfully read ", infile);
+    // Solve everything in the manifest in batch mode
+    if (batch) {
+        auto failures = solve_batch<R>(argv[2]);
+        MR_PROFILE_REPORT();
+        return failures == 0 ? 0 : 1;
+    }
 
-        // Solve
-        m.solve();
-        print("Solved; simulation time: ", m.sim_time());
+    // Solve jobs from the spool directory until told to stop in serve mode
+    if (serving) {
+        auto failures = serve<R>(argv[2]);
+        MR_PROFILE_REPORT();
+        return failures == 0 ? 0 : 1;
+    }
 
-        // Write to outfile
-        m.write(outfile);
-        print("Successfully wrote ", outfile);
+    // Read from infile, or its latest checkpoint if restarting
+    auto validate = precision_validation_requested<R>();
+    auto compare = euler_comparison_requested();
+    if ((validate || compare) && std::getenv("INTVL") != nullptr) {
+        throw std::logic_error(std::string("Checkpointing (INTVL) can't be used when ") +
+                               (validate ? "validating precision" : "comparing to Euler integration") +
+                               ", since both solves would write the same checkpoint files");
+    }
+    auto startfile = restart ? R::latest_checkpoint(infile) : std::string(infile);
+    auto m = R(startfile.c_str());
+    print("Successfully read ", startfile);
 
-        // Return 0 if we made it this far
-        return 0;
+    // Solve
+    auto start_time = std::chrono::steady_clock::now();
+    m.solve();
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    print("Solved; simulation time: ", m.sim_time());
+    if (m.accepted_steps() > 0) {
+        print("Adaptive integration took ", m.accepted_steps(), " steps (", m.rejected_steps(), " rejected)");
+    }
+    if (auto report = m.bandwidth_report(); !report.empty()) print(report);
+
+    // Write to outfile
+    m.write(outfile);
+    print("Successfully wrote ", outfile);
+    MR_PROFILE_REPORT();
+
+    // Compare to a double precision solve if requested
+    if (validate && !validate_precision(m, startfile)) return 1;
+
+    // Compare to fixed steps if requested
+    if (compare) compare_to_euler(m, startfile, seconds);
+
+    // Return 0 if we made it this far
+    return 0;
+}
+
+
+
+// Solve with the implementation chosen at compile time, or by SOLVER_BACKEND, reporting errors
+int main(int argc, char **argv) {
+    try {
+        return with_backend([=]<class R>(){ return mountainsolve<R>(argc, argv); }); // https://tinyurl.com/byusc-lambda
 
     // Handle errors
     } catch (const std::logic_error &e) {
@@ -0,0 +1,224 @@
+#pragma once
+#include <array>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <format>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#ifdef USE_MPI
+#include <mpl/mpl.hpp>
+#endif
+
+
+
+// Scoped timers and counters for each phase of a solve, compiled in only with -DMR_PROFILE (the CMake option
+// MOUNTAINSOLVE_PROFILE). Otherwise MR_PROFILE_SCOPE, MR_PROFILE_STEPS, and MR_PROFILE_REPORT expand to nothing, so
+// the hot loops are the same as if they weren't instrumented at all.
+//
+// Each thread accumulates into its own record, so timing a block of work costs two clock reads and no contention.
+// Scopes go around whole blocks or chunks of cells rather than individual cells or tiles to keep that cost small.
+// report() prints, for each phase, how long the threads (and processes) that ran it spent in it and how unevenly that
+// time was spread, along with the effective bandwidth of the memory traffic the phase should cause.
+
+
+
+namespace mr::profile {
+    // Phases of a solve
+    enum class phase { update_h, update_g, dsteepness, fused_sweep, temporal_sweep, barrier_wait, halo_exchange,
+                       allreduce, checkpoint, write, integrator, count };
+    inline constexpr size_t phase_count = static_cast<size_t>(phase::count);
+    inline constexpr std::array<const char *, phase_count> phase_names{
+            "update_h", "update_g", "dsteepness", "fused_sweep", "temporal_sweep", "barrier_wait", "halo_exchange",
+            "allreduce", "checkpoint", "write", "integrator"};
+
+    // Time spent in, calls to, and bytes moved by each phase on one thread
+    struct record {
+        std::array<double, phase_count> seconds{}, bytes{};
+        std::array<uint64_t, phase_count> calls{};
+    };
+
+    // Every thread's record; a deque so that records don't move as threads are added
+    inline std::mutex records_mutex;
+    inline std::deque<record> records;
+
+    // Steps taken by every solve
+    inline std::atomic<uint64_t> steps{0};
+
+    // This thread's record, created the first time this thread is profiled
+    inline record &this_thread() {
+        thread_local record *r = []{
+            std::lock_guard lock(records_mutex);
+            return &records.emplace_back();
+        }(); // https://tinyurl.com/byusc-lambdai
+        return *r;
+    }
+
+
+
+    // Adds the time from its construction to its destruction to a phase of this thread's record
+    class scope {
+        const phase p;
+        const double bytes;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    public:
+        scope(phase p, double bytes=0): p{p}, bytes{bytes} {}
+        scope(const scope &) = delete;
+        ~scope() {
+            auto &r = this_thread();
+            auto i = static_cast<size_t>(p);
+            r.seconds[i] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            r.bytes[i] += bytes;
+            r.calls[i] += 1;
+        }
+    };
+
+
+
+    // Statistics of a phase over the threads (or processes) that ran it
+    struct spread {
+        double min = 0, mean = 0, max = 0;
+        double imbalance() const { return mean > 0 ? max / mean : 1; }
+    };
+
+    inline spread spread_of(const std::vector<double> &xs) {
+        if (xs.empty()) return {};
+        auto [min, max] = std::ranges::minmax(xs); // https://tinyurl.com/byusc-structbind
+        double sum = 0;
+        for (auto x: xs) sum += x;
+        return {min, sum / xs.size(), max};
+    }
+
+    // Totals and spreads of a phase over every thread of every process
+    struct phase_summary {
+        uint64_t calls = 0;
+        double bytes = 0;
+        std::vector<double> thread_seconds;  // time each thread that ran the phase spent in it
+        std::vector<double> process_seconds; // time the slowest thread of each process spent in it
+    };
+
+
+
+    // Summarize every thread's record, gathering the records of other processes to the first process if MPI is used
+    inline std::array<phase_summary, phase_count> summarize() {
+        // Flatten this process's records into rows of (seconds, bytes, calls) for each phase
+        constexpr size_t fields = 3 * phase_count;
+        std::vector<double> local;
+        {
+            std::lock_guard lock(records_mutex);
+            for (const auto &r: records) {
+                for (size_t i=0; i<phase_count; i++) {
+                    local.insert(local.end(), {r.seconds[i], r.bytes[i], static_cast<double>(r.calls[i])});
+                }
+            }
+        }
+
+        // Gather every process's rows, padded to the same number of threads
+        std::vector<double> rows = local;
+        std::vector<size_t> process_threads{local.size() / fields};
+#ifdef USE_MPI
+        const auto &comm_world = mpl::environment::comm_world();
+        auto nthreads = local.size() / fields;
+        comm_world.allreduce(mpl::max<size_t>(), nthreads);
+        local.resize(nthreads * fields);
+        rows.resize(comm_world.rank() == 0 ? local.size() * comm_world.size() : 0);
+        auto layout = mpl::vector_layout<double>(local.size());
+        comm_world.gather(0, local.data(), layout, rows.data(), layout);
+        process_threads.assign(comm_world.size(), nthreads);
+#endif
+
+        // Tally each phase
+        std::array<phase_summary, phase_count> summaries;
+        auto row = rows.begin();
+        for (auto nthreads: process_threads) {
+            std::array<double, phase_count> slowest{};
+            for (size_t tid=0; tid<nthreads && row!=rows.end(); tid++, row+=fields) {
+                for (size_t i=0; i<phase_count; i++) {
+                    auto seconds = row[3*i], bytes = row[3*i+1], calls = row[3*i+2];
+                    if (calls == 0) continue;
+                    summaries[i].calls += calls;
+                    summaries[i].bytes += bytes;
+                    summaries[i].thread_seconds.push_back(seconds);
+                    slowest[i] = std::max(slowest[i], seconds);
+                }
+            }
+            for (size_t i=0; i<phase_count; i++) {
+                if (slowest[i] > 0) summaries[i].process_seconds.push_back(slowest[i]);
+            }
+        }
+        return summaries;
+    }
+
+
+
+    // Print each phase's calls, time, load imbalance (the slowest thread's time over the mean), and bandwidth (bytes
+    // over the slowest thread's time) to os, and write the same as JSON to the file named by the environment variable
+    // SOLVER_PROFILE_JSON if it's set. Every process must call this if MPI is used, but only the first prints.
+    inline void report(std::ostream &os=std::cerr) {
+        auto summaries = summarize();
+#ifdef USE_MPI
+        if (mpl::environment::comm_world().rank() > 0) return;
+#endif
+
+        // Text
+        os << std::format("Profile of {} steps\n", steps.load())
+           << std::format("{:<15}{:>10}{:>9}{:>12}{:>12}{:>12}{:>11}{:>11}{:>9}\n", "phase", "calls", "threads",
+                          "min s", "mean s", "max s", "imbalance", "proc imb", "GB/s");
+        for (size_t i=0; i<phase_count; i++) {
+            const auto &s = summaries[i];
+            if (s.calls == 0) continue;
+            auto threads = spread_of(s.thread_seconds), processes = spread_of(s.process_seconds);
+            os << std::format("{:<15}{:>10}{:>9}{:>12.4f}{:>12.4f}{:>12.4f}{:>11.3f}{:>11.3f}{:>9.2f}\n",
+                              phase_names[i], s.calls, s.thread_seconds.size(), threads.min, threads.mean,
+                              threads.max, threads.imbalance(), processes.imbalance(),
+                              threads.max > 0 ? s.bytes / threads.max / 1e9 : 0.0);
+        }
+        os << std::flush;
+
+        // JSON
+        auto json_filename = std::getenv("SOLVER_PROFILE_JSON");
+        if (json_filename == nullptr) return;
+        auto f = std::ofstream(json_filename);
+        f << std::format("{{\"steps\": {}, \"phases\": {{", steps.load());
+        auto separator = "";
+        for (size_t i=0; i<phase_count; i++) {
+            const auto &s = summaries[i];
+            if (s.calls == 0) continue;
+            auto threads = spread_of(s.thread_seconds), processes = spread_of(s.process_seconds);
+            f << std::format("{}\n  \"{}\": {{\"calls\": {}, \"threads\": {}, \"processes\": {}, \"bytes\": {}, "
+                             "\"thread_seconds\": {{\"min\": {}, \"mean\": {}, \"max\": {}}}, "
+                             "\"process_seconds\": {{\"min\": {}, \"mean\": {}, \"max\": {}}}, "
+                             "\"thread_imbalance\": {}, \"process_imbalance\": {}, \"gb_per_second\": {}}}",
+                             separator, phase_names[i], s.calls, s.thread_seconds.size(), s.process_seconds.size(),
+                             s.bytes, threads.min, threads.mean, threads.max, processes.min, processes.mean,
+                             processes.max, threads.imbalance(), processes.imbalance(),
+                             threads.max > 0 ? s.bytes / threads.max / 1e9 : 0.0);
+            separator = ",";
+        }
+        f << "\n}}\n";
+    }
+}
+
+
+
+// MR_PROFILE_SCOPE(phase, bytes) times the rest of the enclosing block as a phase (one of mr::profile::phase) that
+// moves bytes bytes, MR_PROFILE_STEPS(n) counts n steps, and MR_PROFILE_REPORT() calls report()
+#define MR_PROFILE_CONCAT_(a, b) a##b
+#define MR_PROFILE_CONCAT(a, b) MR_PROFILE_CONCAT_(a, b)
+#ifdef MR_PROFILE
+#define MR_PROFILE_SCOPE(phase_name, ...) \
+    mr::profile::scope MR_PROFILE_CONCAT(mr_profile_scope_, __LINE__){mr::profile::phase::phase_name __VA_OPT__(,) __VA_ARGS__}
+#define MR_PROFILE_STEPS(n) (mr::profile::steps += (n))
+#define MR_PROFILE_REPORT() mr::profile::report()
+#else
+#define MR_PROFILE_SCOPE(phase_name, ...)
+#define MR_PROFILE_STEPS(n)
+#define MR_PROFILE_REPORT()
+#endif
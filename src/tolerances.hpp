@@ -0,0 +1,10 @@
+#pragma once
+
+
+
+// How close two mountain ranges have to be for mountaindiff to consider them the same: the ratio of their simulation
+// times, and the RMS difference of their heights over the RMS height of the expected range
+namespace mr {
+    inline constexpr double acceptable_time_ratio         = 1.0001,
+                            acceptable_height_error_ratio = 0.000001; // TODO: should this increase with time?
+}
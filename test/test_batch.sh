@@ -0,0 +1,35 @@
+#!/usr/bin/env bash
+
+# Runs the supplied solver in batch mode on a manifest that solves the supplied infile several times, once with the
+# ranges solved in lockstep as an ensemble, once with every range solved whole by a worker, and once with every range
+# split across all threads, and ensures that each output matches with the supplied expected outfile
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: the same as for test_solver.sh
+
+# Example:
+# test/test_batch.sh bld/mountaindiff mpirun -n 3 bld/solver_mpi samples/tiny-1D-in.dat samples/tiny-1D-out.dat
+
+set -e
+
+# Parse
+mtn_diff="$1"
+infile="${@:$#-1:1}"
+expected="${@:$#:1}"
+
+# Outfiles and manifest
+workdir="$(mktemp -d)"
+trap 'rm -r "$workdir"' EXIT
+for i in 1 2 3 4 5; do
+    echo "$infile $workdir/out-$i.mr" >> "$workdir/manifest"
+done
+
+# Run solver with the default settings, without ensembles, then with no memory budget at all
+for setting in SOLVER_BATCH_ENSEMBLE=64 SOLVER_BATCH_ENSEMBLE=1 SOLVER_BATCH_MEMORY=0; do
+    env "$setting" "${@:2:$#-3}" --batch "$workdir/manifest"
+    for i in 1 2 3 4 5; do
+        "$mtn_diff" "$expected" "$workdir/out-$i.mr"
+        rm "$workdir/out-$i.mr"
+    done
+done
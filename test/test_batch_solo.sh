@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+
+# Generates a range small enough to be solved as part of an ensemble, solves it alone with the supplied solver, then
+# solves several copies of it in batch mode, and ensures that each copy's output matches the lone solve's, so that a
+# range's answer doesn't depend on what else is in the manifest
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: the mountaindiff binary, the mountaingen binary, then the command (and optionally its arguments) to run the
+# solver
+
+# Example:
+# test/test_batch_solo.sh bld/mountaindiff bld/mountaingen bld/mountainsolve_float
+
+set -e
+
+# Parse
+mtn_diff="$1"
+mountaingen="$2"
+
+# Range, outfiles, and manifest
+workdir="$(mktemp -d)"
+trap 'rm -r "$workdir"' EXIT
+"$mountaingen" hump 200 "$workdir/in.mr"
+for i in 1 2 3; do
+    echo "$workdir/in.mr $workdir/out-$i.mr" >> "$workdir/manifest"
+done
+
+# Solve alone, then in batch mode
+"${@:3}" "$workdir/in.mr" "$workdir/alone.mr"
+"${@:3}" --batch "$workdir/manifest"
+for i in 1 2 3; do
+    "$mtn_diff" "$workdir/alone.mr" "$workdir/out-$i.mr"
+done
@@ -0,0 +1,37 @@
+#!/usr/bin/env bash
+
+# Runs bench/mountainbench.sh on the smallest ranges, then ensures that its results pass when compared to a baseline
+# that's half as fast and are flagged as regressions when compared to one that's ten times as fast
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: mountainbench.sh and the build directory
+
+# Example:
+# test/test_bench.sh bench/mountainbench.sh bld
+
+set -e
+
+# Parse
+mountainbench="$1"
+bindir="$2"
+
+# Results and baselines
+workdir="$(mktemp -d)"
+trap 'rm -r "$workdir"' EXIT
+scaled_baseline() {
+    awk -F, -v OFS=, -v factor="$1" 'FNR > 1 { $7 *= factor } 1' "$workdir/results.csv" > "$workdir/baseline-$1.csv"
+}
+
+# Benchmark
+export MOUNTAINBENCH_MAX_CELLS=1024
+bash "$mountainbench" "$bindir" "$workdir/results.csv"
+grep -q '^serial,1,1,solve,1024,.*,1.000$' "$workdir/results.csv"
+
+# Compare
+scaled_baseline 0.5
+bash "$mountainbench" "$bindir" "$workdir/results.csv" "$workdir/baseline-0.5.csv"
+scaled_baseline 10
+if bash "$mountainbench" "$bindir" "$workdir/results.csv" "$workdir/baseline-10.csv"; then
+    exit 1
+fi
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+
+# Runs the supplied mountaingen with 1 and 3 threads on a range spanning several batches, and ensures that the outputs
+# are identical and the right size, and that a different seed gives a different range
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: mountaingen
+
+# Example:
+# test/test_gen.sh bld/mountaingen
+
+set -e
+
+# Parse
+mountaingen="$1"
+
+# Outfiles
+workdir="$(mktemp -d)"
+trap 'rm -r "$workdir"' EXIT
+
+# Generate, with a cell count that isn't a multiple of anything in particular
+cells=2097155
+OMP_NUM_THREADS=1 "$mountaingen" noise "$cells" "$workdir/1.mr" 7
+OMP_NUM_THREADS=3 "$mountaingen" noise "$cells" "$workdir/3.mr" 7
+"$mountaingen" noise "$cells" "$workdir/other-seed.mr" 8
+
+# Compare
+cmp "$workdir/1.mr" "$workdir/3.mr"
+[[ "$(wc -c < "$workdir/1.mr")" -eq $((24 + 16 * cells)) ]]
+! cmp -s "$workdir/1.mr" "$workdir/other-seed.mr"
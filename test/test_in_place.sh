@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+
+# Runs the supplied solver on a copy of the supplied infile, writing the output over that same copy, and ensures that it
+# matches with the supplied expected outfile
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: the same as for test_solver.sh
+
+# Example:
+# SOLVER_MMAP=1 test/test_in_place.sh bld/mountaindiff bld/solver_serial samples/tiny-1D-in.dat samples/tiny-1D-out.dat
+
+set -e
+
+# Parse
+mtn_diff="$1"
+infile="${@:$#-1:1}"
+expected="${@:$#:1}"
+
+# Copy of infile to solve in place
+inoutfile="$(mktemp)"
+trap 'rm "$inoutfile"' EXIT
+cp "$infile" "$inoutfile"
+
+# Run solver, reading from and writing to the same file
+"${@:2:$#-3}" "$inoutfile" "$inoutfile"
+
+# Make sure the result and expected are similar enough
+"$mtn_diff" "$expected" "$inoutfile"
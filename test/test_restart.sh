@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+
+# Runs the supplied solver on the supplied infile with checkpoints, pretends the run was cut short partway through a
+# checkpoint, restarts the solver, and ensures that it resumed from the right checkpoint and that its output matches
+# with the supplied expected outfile
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: the same as for test_solver.sh, except that the solver must be on the PATH or given by absolute path and
+# the infile must take at least 4 units of simulation time to solve
+
+# Example:
+# test/test_restart.sh bld/mountaindiff mpirun -n 3 bld/solver_mpi samples/tiny-1D-in.dat samples/tiny-1D-out.dat
+
+set -e
+
+# Parse
+mtn_diff="$(realpath "$1")"
+infile="$(realpath "${@:$#-1:1}")"
+expected="$(realpath "${@:$#:1}")"
+
+# Checkpoints are written to the working directory, so work in a temporary one
+workdir="$(mktemp -d)"
+trap 'rm -r "$workdir"' EXIT
+cd "$workdir"
+
+# Run solver, checkpointing every unit of simulation time
+INTVL=1 "${@:2:$#-3}" "$infile" uninterrupted.mr
+
+# Pretend the run was cut short while the checkpoint at time 4 was being written
+find . -name 'chk-*.wo' ! -name 'chk-000[1-4].00.wo' -delete
+truncate -s 100 chk-0004.00.wo
+
+# Restart, which should pick up from the checkpoint at time 3
+output="$("${@:2:$#-3}" --restart "$infile" restarted.mr)"
+[[ "$output" == *chk-0003.00.wo* ]]
+
+# Make sure restarted and expected are similar enough
+"$mtn_diff" "$expected" restarted.mr
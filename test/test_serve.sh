@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+
+# Runs the supplied solver in serve mode on a spool directory, submits a job that solves the supplied infile twice and
+# then another that solves it once more, ensures that each output matches with the supplied expected outfile and that
+# later ranges reused the first one's memory, then stops the solver
+
+# Since this is only used for testing with CMake, there is no error handling, no help message, etc.
+
+# Arguments: the same as for test_solver.sh
+
+# Example:
+# test/test_serve.sh bld/mountaindiff bld/solver_thread samples/tiny-1D-in.dat samples/tiny-1D-out.dat
+
+set -e
+
+# Parse
+mtn_diff="$1"
+infile="${@:$#-1:1}"
+expected="${@:$#:1}"
+
+# Spool directory, with the solver serving it in the background
+workdir="$(mktemp -d)"
+spool="$workdir/spool"
+mkdir "$spool"
+"${@:2:$#-3}" --serve "$spool" &
+solver=$!
+trap 'kill $solver 2>/dev/null || true; rm -r "$workdir"' EXIT
+
+# Submit a job, writing it under another name first so the solver never sees it half written, and wait for it
+submit() {
+    printf '%s\n' "${@:2}" > "$spool/$1.tmp"
+    mv "$spool/$1.tmp" "$spool/$1.job"
+    for _ in $(seq 600); do
+        grep -q '^done' "$spool/$1.status" 2>/dev/null && break
+        kill -0 $solver # fail if the solver died
+        sleep 0.1
+    done
+    grep -q '^done: solved '$(($# - 1))' of' "$spool/$1.status"
+}
+submit first "$infile $workdir/out-1.mr" "$infile $workdir/out-2.mr"
+submit second "$infile $workdir/out-3.mr"
+
+# Make sure outputs are right, and that only the first range needed new buffers
+for i in 1 2 3; do
+    "$mtn_diff" "$expected" "$workdir/out-$i.mr"
+done
+[[ "$(cat "$spool"/*.status | grep -c 'new buffers')" == 1 ]]
+
+# Stop the solver, which should exit cleanly once it sees the stop file
+touch "$spool/stop"
+wait $solver